@@ -40,6 +40,9 @@ extern "C" {
 #define PW_KEY_WARP_TIMING 1
 #define PW_VAL_ON_ANYTIME 0
 #define PW_VAL_ON_POLLING 1
+#define PW_KEY_WARP_PRECOPY 2
+#define PW_VAL_PRECOPY_OFF 0
+#define PW_VAL_PRECOPY_ON 1
 
   /**
    * Set PROCESS WARP parameter value.
@@ -0,0 +1,30 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+import json
+import sys
+
+# Parse arguments.
+usage = 'Usage: python {} OUTPUT-FILE TRACE-FILE...'.format(__file__)
+args  = sys.argv
+if len(args) < 3:
+    print(usage)
+    sys.exit(1)
+
+events = []
+for idx, in_fname in enumerate(args[2:]):
+    # Trace file is JSON array without terminator, written while the process is running.
+    with open(in_fname) as f:
+        body = f.read().strip()
+    if body.endswith(','):
+        body = body[:-1]
+    if not body.endswith(']'):
+        body += ']'
+
+    # Process-ids can be same on other nodes, so replace them by index of files.
+    for event in json.loads(body):
+        event['pid'] = idx + 1
+        events.append(event)
+
+with open(args[1], 'w') as f:
+    json.dump({'traceEvents': events, 'displayTimeUnit': 'ms'}, f)
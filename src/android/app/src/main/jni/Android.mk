@@ -83,12 +83,15 @@ LOCAL_SRC_FILES  += $(CORE_PATH)/format.cpp
 LOCAL_SRC_FILES  += $(CORE_PATH)/interrupt_memory_require.cpp
 LOCAL_SRC_FILES  += $(CORE_PATH)/logger.cpp
 LOCAL_SRC_FILES  += $(CORE_PATH)/message.cpp
+LOCAL_SRC_FILES  += $(CORE_PATH)/migration_policy.cpp
+LOCAL_SRC_FILES  += $(CORE_PATH)/page_buffer.cpp
 LOCAL_SRC_FILES  += $(CORE_PATH)/process.cpp
 LOCAL_SRC_FILES  += $(CORE_PATH)/scheduler.cpp
 LOCAL_SRC_FILES  += $(CORE_PATH)/stackinfo.cpp
 LOCAL_SRC_FILES  += $(CORE_PATH)/std_error.cpp
 LOCAL_SRC_FILES  += $(CORE_PATH)/symbols.cpp
 LOCAL_SRC_FILES  += $(CORE_PATH)/thread.cpp
+LOCAL_SRC_FILES  += $(CORE_PATH)/trace.cpp
 LOCAL_SRC_FILES  += $(CORE_PATH)/type_store.cpp
 LOCAL_SRC_FILES  += $(CORE_PATH)/util.cpp
 LOCAL_SRC_FILES  += $(CORE_PATH)/vmachine.cpp
@@ -65,10 +65,16 @@ class RouterJni : public SchedulerDelegate {
    * @param proc_addr Address of process information for new vm.
    * @param master_nid Node-id of master node for new vm.
    * @param name Process name for new vm.
+   * @param image Path of memory image to restore, ignored because loader doesn't run on the
+   * same host as Android and gives pages by packets.
    */
   void scheduler_create_vm(Scheduler& scheduler, const vpid_t& pid, vtid_t root_tid,
                            vaddr_t proc_addr, const nid_t& master_nid,
-                           const std::string& name) override {
+                           const std::string& name, const std::string& image) override {
+    if (!image.empty()) {
+      JniUtil::log_w("RouterJni::scheduler_create_vm memory image is ignored (%s)\n",
+                     image.c_str());
+    }
     JniUtil::log_v("RouterJni::scheduler_create_vm\n");
     JNIEnv* env   = env_stack.top();
     jstring jpid  = env->NewStringUTF(Convert::vpid2str(pid).c_str());
@@ -14,12 +14,16 @@ static const uint8_t I8_TRUE    = 0x1;
 /** Value of false in virtual-machine. */
 static const uint8_t I8_FALSE   = 0x0;
 
-/** Threshold of access count for change owner or occasion to copy. */
-static const int MEMORY_REFERRAL_LIMIT  = 5;
-/** Interval time of send require packet (sec). */
-static const int MEMORY_REQUIRE_INTERVAL    = 5;
+/** Interval time of resend copy packet without responce (msec). */
+static const int MEMORY_REQUIRE_INTERVAL    = 200;
+/** Interval time of resend warp packet without result (msec). */
+static const int WARP_RESEND_INTERVAL       = 1000;
+/** Time limit to wait threads stop for checkpoint (msec). */
+static const int CHECKPOINT_TIMEOUT         = 10000;
 /** Heartbeat interval.(sec) */
 static const int HEARTBEAT_INTERVAL = 3;
+/** Interval to send statistics of memory with heartbeat.(sec) */
+static const int HEARTBEAT_STATS_INTERVAL = 30;
 /** Interval to call Scheduler::execute.(sec) */
 static const int SCHEDULER_EXECUTE_INTERVAL = HEARTBEAT_INTERVAL;
 /** Deadline time for unresponsive module.(sec) */
@@ -154,6 +158,7 @@ static const Type OR_NANS       = 45;
 static const Type SELECT        = 46;
 static const Type SHUFFLE       = 47;
 static const Type VA_ARG        = 48;
+static const Type ATOMIC        = 49;
 }  // namespace Opcode
 
 namespace OperandMask {
@@ -187,4 +192,117 @@ static const unsigned int MIN   = 8;
 static const unsigned int BASE  = 16;
 static const unsigned int MAX   = 64;
 }  // namespace VMemoryReserve
+
+/**
+ * Address lease.
+ * Address space of a wide region is partitioned by hash of node-id, each node assigns addresses
+ * from own partition without reserve command.
+ */
+namespace VMemoryLease {
+static const unsigned int PARTITION_BITS  = 16;  ///< Bit width of partition index.
+static const unsigned int MIN_FREE_BITS   = 12;  ///< Region having less bits uses reserve command.
+}  // namespace VMemoryLease
+
+/**
+ * Directory of master node for pages not in this node.
+ */
+namespace VMemoryDirectory {
+static const unsigned int MAX_ENTRIES = 65536;  ///< Limit of entries per memory space.
+static const unsigned int MAX_HOP     = 4;      ///< Limit of relay for require before broad cast.
+}  // namespace VMemoryDirectory
+
+/**
+ * Storage of page value.
+ */
+namespace VMemoryBuffer {
+static const uint64_t MMAP_THRESHOLD  = 256 * 1024;  ///< Buffer at least this size is mapped.
+}  // namespace VMemoryBuffer
+
+/**
+ * Chunk of large page to transfer independently.
+ */
+namespace VMemoryChunk {
+static const uint64_t SIZE  = 64 * 1024;  ///< Size of chunk, larger page than it is chunked.
+}  // namespace VMemoryChunk
+
+/**
+ * Prefetch of pages pointed by arrived page.
+ */
+namespace VMemoryPrefetch {
+static const unsigned int DEPTH     = 4;   ///< Limit of pointer chasing from a required page.
+static const unsigned int MAX_ADDRS = 16;  ///< Limit of addresses to prefetch per arrived page.
+}  // namespace VMemoryPrefetch
+
+/**
+ * Translation cache in memory accessor.
+ */
+namespace VMemoryCache {
+static const unsigned int BITS  = 6;  ///< Bit width of cache index.
+static const unsigned int SIZE  = 1 << BITS;  ///< Count of cache entries.
+}  // namespace VMemoryCache
+
+/**
+ * Default migration policy of master flag and copy.
+ */
+namespace VMemoryMigration {
+static const int WINDOW             = 10;  ///< Interval to halve access counters (sec).
+static const unsigned int WRITE_STREAK  = 4;  ///< Consecutive writes to give master flag.
+static const unsigned int READ_LIMIT    = 8;  ///< Reads by a node to give unused master flag.
+static const unsigned int PIN_GIVES     = 3;  ///< Gives in window to pin master flag.
+static const unsigned int COPY_LIMIT    = 5;  ///< Copies without access to unwant idle copy.
+}  // namespace VMemoryMigration
+
+/**
+ * Budget of copy pages in a memory space.
+ */
+namespace VMemoryCopyCache {
+static const uint64_t BUDGET  = 64 * 1024 * 1024;  ///< Default bytes of copy pages to keep.
+static const uint64_t LOW_WATER_DIVISOR = 8;  ///< Evict 1/8 of budget more than exceeded bytes.
+}  // namespace VMemoryCopyCache
+
+/**
+ * Atomic operation executed by master of the page.
+ */
+namespace VMemoryAtomic {
+static const size_t REPLIES = 64;  ///< Replies kept for each origin to answer resent operation.
+}  // namespace VMemoryAtomic
+
+/**
+ * Memory operation executed by master for a write on copy page.
+ */
+namespace VMemoryUpdate {
+static const size_t REPLIES = 256;  ///< Replies kept for each origin to answer resent operation.
+}  // namespace VMemoryUpdate
+
+/**
+ * Pages given with warp of a thread.
+ */
+namespace VMemoryWarp {
+static const uint64_t BUDGET  = 4 * 1024 * 1024;  ///< Default bytes of recently accessed pages.
+static const int PRECOPY_INTERVAL = 100;  ///< Interval of pre-copy rounds (msec).
+static const uint64_t PRECOPY_THRESHOLD = 256 * 1024;  ///< Dirty bytes to stop thread and warp.
+static const unsigned int PRECOPY_ROUNDS = 8;  ///< Limit of pre-copy rounds.
+static const uint64_t BUNDLE_BYTES = 1024 * 1024;  ///< Bytes of values sent by a warp command.
+static const uint64_t PRECOPY_TIMEOUT = 60 * 1000;  ///< Keep time of aborted pre-copy (msec).
+}  // namespace VMemoryWarp
+
+/**
+ * Cost model used by scheduler to decide warp of a thread.
+ */
+namespace WarpCost {
+static const uint64_t BANDWIDTH = 4 * 1024 * 1024;  ///< Expected bandwidth of network (byte/sec).
+static const uint64_t LATENCY   = 100;  ///< Fixed cost of a warp, safe point and reply (msec).
+static const uint64_t PAGE_COST = 1;    ///< Cost for each page given and each frame (msec).
+static const uint64_t HORIZON   = 30 * 1000;  ///< Time a thread runs after warp to gain (msec).
+static const int DEFER_LIMIT    = 30;   ///< Time to retry deferred warp before dropping it (sec).
+}  // namespace WarpCost
+
+/**
+ * Binary image of memory space written by checkpoint.
+ */
+namespace VMemoryImage {
+static const uint32_t MAGIC   = 0x47575750;  ///< Head of image ("PWWG" in little endian).
+static const uint32_t VERSION = 1;  ///< Version of image format.
+static const uint64_t BLOCK   = 4096;  ///< Unit to skip zero range (bytes).
+}  // namespace VMemoryImage
 }  // namespace processwarp
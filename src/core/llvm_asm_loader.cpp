@@ -1584,44 +1584,32 @@ void LlvmAsmLoader::convert_inst_atomic_cmp_xchg
 
 void LlvmAsmLoader::convert_inst_rmw(FunctionContext& fc,
                                      const llvm::AtomicRMWInst& inst) {
+  VMemory::AtomicType type = VMemory::AT_XCHG;
   switch (inst.getOperation()) {
-    /**
-     * @param INS AtomicRMWの演算
-     * @param OP 対応する仮想マシンのOpcode
-     * @param SI 符号あり演算の場合trueを指定する。
-     */
-#define M_ATOMIC_RMW(INS, OP, SI)                                       \
-    case llvm::AtomicRMWInst::INS: {                                    \
-      /* set_type <ty> */                                               \
-      int type_operand = assign_type                                    \
-                         (fc, inst.getValOperand()->getType(), SI);     \
-      push_code(fc, Opcode::SET_TYPE, type_operand);                    \
-      /* set_output <old> */                                            \
-      push_code(fc, Opcode::SET_OUTPUT, assign_operand(fc, &inst));     \
-      /* set_ov_ptr <pointer> */                                        \
-      int pointer_operand = assign_operand                              \
-                            (fc, inst.getPointerOperand());             \
-      push_code(fc, Opcode::SET_OV_PTR, pointer_operand);               \
-      /* <operation> <value> */                                         \
-      int value_operand = assign_operand                                \
-                          (fc, inst.getValOperand());                   \
-      push_code(fc, Opcode::OP, value_operand);                         \
-    } break;
-
-    M_ATOMIC_RMW(Xchg, SET, false);
-    M_ATOMIC_RMW(Add,  ADD, false);
-    M_ATOMIC_RMW(Sub,  SUB, false);
-    M_ATOMIC_RMW(And,  AND, false);
-    M_ATOMIC_RMW(Nand, NAND, false);
-    M_ATOMIC_RMW(Or,   OR,  false);
-    M_ATOMIC_RMW(Xor,  XOR, false);
-    M_ATOMIC_RMW(Max,  MAX, true);
-    M_ATOMIC_RMW(Min,  MIN, true);
-    M_ATOMIC_RMW(UMax, MAX, false);
-    M_ATOMIC_RMW(UMin, MIN, false);
-#undef M_ATOMIC_RMW
+    case llvm::AtomicRMWInst::Xchg: type = VMemory::AT_XCHG; break;
+    case llvm::AtomicRMWInst::Add:  type = VMemory::AT_ADD;  break;
+    case llvm::AtomicRMWInst::Sub:  type = VMemory::AT_SUB;  break;
+    case llvm::AtomicRMWInst::And:  type = VMemory::AT_AND;  break;
+    case llvm::AtomicRMWInst::Nand: type = VMemory::AT_NAND; break;
+    case llvm::AtomicRMWInst::Or:   type = VMemory::AT_OR;   break;
+    case llvm::AtomicRMWInst::Xor:  type = VMemory::AT_XOR;  break;
+    case llvm::AtomicRMWInst::Max:  type = VMemory::AT_MAX;  break;
+    case llvm::AtomicRMWInst::Min:  type = VMemory::AT_MIN;  break;
+    case llvm::AtomicRMWInst::UMax: type = VMemory::AT_UMAX; break;
+    case llvm::AtomicRMWInst::UMin: type = VMemory::AT_UMIN; break;
     default: assert(false);
   }
+
+  // set_type <ty>
+  push_code(fc, Opcode::SET_TYPE, assign_type(fc, inst.getValOperand()->getType()));
+  // set_output <old>
+  push_code(fc, Opcode::SET_OUTPUT, assign_operand(fc, &inst));
+  // set_ptr <pointer>
+  push_code(fc, Opcode::SET_PTR, assign_operand(fc, inst.getPointerOperand()));
+  // set_value <value>
+  push_code(fc, Opcode::SET_VALUE, assign_operand(fc, inst.getValOperand()));
+  // atomic <operation>
+  push_code(fc, Opcode::ATOMIC, type);
 }
 
 void LlvmAsmLoader::convert_inst_get_element_ptr
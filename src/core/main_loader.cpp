@@ -1,11 +1,16 @@
 
+#include <fcntl.h>
 #include <picojson.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <cerrno>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -22,6 +27,7 @@
 #include "message.hpp"
 #include "process.hpp"
 #include "type.hpp"
+#include "util.hpp"
 #include "vmemory.hpp"
 
 #ifndef LLVM_VERSION_STRING
@@ -46,9 +52,15 @@ static const char* LLVM_VERSION_STRING =
 namespace processwarp {
 
 static const char* POOL_PATH = "/tmp/";
+/** Default directory to store cache of loaded program. */
+static const char* CACHE_PATH = "/tmp/processwarp_cache/";
+/** Version of cached program, change it when output of LlvmAsmLoader is changed. */
+static const int CACHE_VERSION = 1;
+/** Time to wait the worker opens named pipe of memory image (msec). */
+static const int IMAGE_PIPE_TIMEOUT = 30 * 1000;
 
 /**
- * Load program from LLVM-IR and write a dump file.
+ * Load program from LLVM-IR and write a memory image.
  */
 class Loader : public ProcessDelegate, public VMemoryDelegate {
  public:
@@ -66,6 +78,13 @@ class Loader : public ProcessDelegate, public VMemoryDelegate {
   std::string in_src_account;
   /** LLVM-IR type LL or BC. */
   std::string in_type;
+  /**
+   * Path of named pipe to pass memory image to the worker, empty if the destination isn't on
+   * this host and pages are passed by give packets.
+   */
+  std::string in_image_path;
+  /** Directory to store cache of loaded program. */
+  std::string in_cache_dir;
 
   /** The root thread-id assigned by loader. */
   vtid_t out_root_tid;
@@ -119,6 +138,18 @@ class Loader : public ProcessDelegate, public VMemoryDelegate {
         loader.in_src_nid = Convert::json2nid(result.at("src_nid"));
         loader.in_src_account = result.at("src_account").get<std::string>();
         loader.in_type        = result.at("type").get<std::string>();
+        // Memory image can be read only if the destination runs on this host.
+        auto it_local = result.find("local");
+        if (result.find("image_path") != result.end()) {
+          loader.in_image_path = result.at("image_path").get<std::string>();
+        } else if (it_local != result.end() && it_local->second.get<bool>()) {
+          loader.in_image_path = POOL_PATH + Convert::vpid2str(loader.in_pid) + ".image";
+        }
+        if (result.find("cache_dir") != result.end()) {
+          loader.in_cache_dir = result.at("cache_dir").get<std::string>();
+        } else {
+          loader.in_cache_dir = CACHE_PATH;
+        }
 
         // Convert arguments.
         std::vector<std::string> args;
@@ -126,13 +157,28 @@ class Loader : public ProcessDelegate, public VMemoryDelegate {
           args.push_back(it.get<std::string>());
         }
         // Load.
-        loader.load(args);
+        std::unique_ptr<Process> proc = loader.load(args);
+
+        // Result is shown before writing to a named pipe, the reader starts by the result.
+        bool is_pipe = !loader.in_image_path.empty() && loader.make_pipe();
+        if (!loader.in_image_path.empty() && !is_pipe) loader.write_image(*proc);
+        loader.write_packets(*proc);
 
         // Show result.
         result.insert(std::make_pair("result", picojson::value(0.0)));
         result.insert(std::make_pair("root_tid", Convert::vtid2json(loader.out_root_tid)));
+        if (!loader.in_image_path.empty()) {
+          result.insert(std::make_pair("image_path", picojson::value(loader.in_image_path)));
+        }
 
-        std::cout << picojson::value(result).serialize() << '\0';
+        std::cout << picojson::value(result).serialize() << '\0' << std::flush;
+        if (is_pipe) {
+          int fd = loader.wait_pipe_reader();
+          if (fd >= 0) {
+            loader.write_image(*proc);
+            close(fd);
+          }
+        }
         Logger::info(LoaderMid::L2004, 0, loader.out_root_tid);
       } catch(const Error& ex) {
         // Show error information.
@@ -213,10 +259,10 @@ class Loader : public ProcessDelegate, public VMemoryDelegate {
   /**
    * Main routine of loader.
    * Allocate Process class instance and load LLVM-IR file.
-   * At last, write dump of pages in memory to output file.
    * @param args Command line arguments for loading process.
+   * @return Loaded process.
    */
-  void load(const std::vector<std::string>& args) {
+  std::unique_ptr<Process> load(const std::vector<std::string>& args) {
     // Setup virtual-memory.
     vmemory.set_loading(Convert::vpid2str(in_pid), true);
     // Setup virtual machine.
@@ -230,18 +276,8 @@ class Loader : public ProcessDelegate, public VMemoryDelegate {
                                                  builtin_funcs));
     proc->setup();
 
-    // Load program from LLVM file.
-    LlvmAsmLoader loader(*proc);
-
-    if (in_type == "LL") {
-      loader.load_ir_file(POOL_PATH + Convert::vpid2str(in_pid) + ".llvm");
-
-    } else if (in_type == "BC") {
-      loader.load_bc_file(POOL_PATH + Convert::vpid2str(in_pid) + ".llvm");
-
-    } else {
-      throw_error(Error::SERVER_SYS);
-    }
+    // Load program from cache or LLVM file.
+    load_program(*proc);
 
     std::map<std::string, std::string> envs;
     // Run virtual machine for bind argument and environment variables.
@@ -256,7 +292,187 @@ class Loader : public ProcessDelegate, public VMemoryDelegate {
     // Write out data to memory.
     proc->proc_memory->write_out();
 
-    // Dump and write to file.
+    return proc;
+  }
+
+  /**
+   * Load program from LLVM file, or from cache if the same file was loaded before.
+   * Cache contains pages written by LlvmAsmLoader and symbol table of functions, it is keyed
+   * by hash of the file, type and versions of LLVM and cache.
+   * @param proc Process to load program.
+   */
+  void load_program(Process& proc) {
+    std::string llvm_path = POOL_PATH + Convert::vpid2str(in_pid) + ".llvm";
+    if (in_type != "LL" && in_type != "BC") {
+      throw_error(Error::SERVER_SYS);
+    }
+
+    std::string cache_path;
+    {
+      std::ifstream ifs(llvm_path, std::ios::in | std::ios::binary);
+      std::stringstream content;
+      content << ifs.rdbuf();
+      if (ifs) {
+        std::stringstream key;
+        key << in_type << '\0' << LLVM_VERSION_STRING << '\0' << CACHE_VERSION << '\0' <<
+            content.str();
+        cache_path = in_cache_dir + Util::calc_sha256(key.str()) + ".image";
+      }
+    }
+
+    if (!cache_path.empty() && read_cache(proc, cache_path)) {
+      return;
+    }
+
+    LlvmAsmLoader loader(proc);
+    if (in_type == "LL") {
+      loader.load_ir_file(llvm_path);
+    } else {
+      loader.load_bc_file(llvm_path);
+    }
+    proc.proc_memory->write_out();
+
+    if (!cache_path.empty()) {
+      write_cache(proc, cache_path);
+    }
+  }
+
+  /**
+   * Read program from cache file.
+   * Cache isn't used if it is broken or its pages collide with pages allocated by this loader,
+   * so the program can be loaded from LLVM file again.
+   * @param proc Process to load program.
+   * @param cache_path Path of cache file.
+   * @return True if program was read.
+   */
+  bool read_cache(Process& proc, const std::string& cache_path) {
+    std::ifstream ifs(cache_path, std::ios::in | std::ios::binary);
+    std::string line;
+    if (!std::getline(ifs, line)) return false;
+
+    picojson::value js_header;
+    std::string err = picojson::parse(js_header, line);
+    if (!err.empty() || !js_header.is<picojson::object>()) return false;
+    const picojson::object& header = js_header.get<picojson::object>();
+
+    try {
+      // Process information and builtin pages allocated already must not be replaced.
+      if (!vmemory.read_image(Convert::vpid2str(in_pid), ifs, false)) return false;
+
+    } catch (const Error& ex) {
+      return false;
+    }
+
+    for (auto& it_global : header.at("globals").get<picojson::object>()) {
+      proc.set_global_value(it_global.first, Convert::json2vaddr(it_global.second));
+    }
+    return true;
+  }
+
+  /**
+   * Write program loaded from LLVM file to cache file.
+   * Cache is written to temporary file and renamed, so a loader running at the same time
+   * doesn't read a cache under writing.
+   * @param proc Process loaded program.
+   * @param cache_path Path of cache file.
+   */
+  void write_cache(Process& proc, const std::string& cache_path) {
+    std::map<vaddr_t, VMemory::PageImage> images = vmemory.snapshot(Convert::vpid2str(in_pid));
+    // Builtin variables and information of this process are not a part of program.
+    for (auto& addr : proc.builtin_addrs) {
+      images.erase(addr);
+    }
+    images.erase(proc.addr);
+
+    picojson::object globals;
+    for (auto& it_global : proc.globals) {
+      globals.insert(std::make_pair(it_global.first->str(), Convert::vaddr2json(it_global.second)));
+    }
+    picojson::object header;
+    header.insert(std::make_pair("globals", picojson::value(globals)));
+
+    mkdir(in_cache_dir.c_str(), 0755);
+    std::string tmp_path = cache_path + "." + Convert::vpid2str(in_pid);
+    std::ofstream ofs(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    ofs << picojson::value(header).serialize() << '\n';
+    VMemory::write_image(images, ofs);
+    ofs.close();
+
+    // Failure to write cache is not an error of loading.
+    if (ofs.fail() || std::rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+      std::remove(tmp_path.c_str());
+    }
+  }
+
+  /**
+   * Make named pipe at the image path if nothing exists there.
+   * A file existing at the path is overwritten as a regular image file.
+   * @return True if the path is a named pipe.
+   */
+  bool make_pipe() {
+    if (mkfifo(in_image_path.c_str(), 0600) == 0) return true;
+
+    struct stat image_stat;
+    return errno == EEXIST && stat(in_image_path.c_str(), &image_stat) == 0 &&
+        S_ISFIFO(image_stat.st_mode);
+  }
+
+  /**
+   * Wait for the worker to open named pipe of memory image, not to block next load forever.
+   * Pipe is removed if no worker opens it within IMAGE_PIPE_TIMEOUT.
+   * Returned descriptor must be closed after writing image, the reader gets end of file when
+   * all writers close the pipe.
+   * @return Descriptor opened for writing, or -1 if no reader opened the pipe.
+   */
+  int wait_pipe_reader() {
+    for (int waited = 0; waited < IMAGE_PIPE_TIMEOUT; waited += 100) {
+      // Opening for writing without blocking fails while there is no reader.
+      int fd = open(in_image_path.c_str(), O_WRONLY | O_NONBLOCK);
+      if (fd >= 0) return fd;
+      if (errno != ENXIO) break;
+      usleep(100 * 1000);
+    }
+
+    Logger::warn(LoaderMid::L2007, in_image_path.c_str());
+    std::remove(in_image_path.c_str());
+    return -1;
+  }
+
+  /**
+   * Write pages of loaded process to image file by the format read by VMachine::restore.
+   * Pages are written one by one, so a reader of named pipe can read them while writing.
+   * @param proc Loaded process.
+   */
+  void write_image(Process& proc) {
+    std::map<vaddr_t, VMemory::PageImage> images = vmemory.snapshot(Convert::vpid2str(in_pid));
+    // Don't export builtin variables.
+    for (auto& addr : proc.builtin_addrs) {
+      images.erase(addr);
+    }
+
+    // Root thread is activated by warp_thread command after restoring.
+    picojson::object header;
+    header.insert(std::make_pair("pid", Convert::vpid2json(in_pid)));
+    header.insert(std::make_pair("root_tid", Convert::vtid2json(proc.root_tid)));
+    header.insert(std::make_pair("name", picojson::value(in_name)));
+    header.insert(std::make_pair("threads", picojson::value(picojson::array())));
+
+    std::ofstream ofs(in_image_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    ofs << picojson::value(header).serialize() << '\n';
+    VMemory::write_image(images, ofs);
+    ofs.close();
+    if (ofs.fail()) {
+      throw_error_message(Error::SERVER_SYS, in_image_path);
+    }
+  }
+
+  /**
+   * Write packets to start loaded process to output file.
+   * Pages are contained as give packets if the destination isn't on this host, otherwise
+   * the new vm reads them from memory image.
+   * @param proc Loaded process.
+   */
+  void write_packets(Process& proc) {
     picojson::object body;
     body.insert(std::make_pair("pid", Convert::vpid2json(in_pid)));
 
@@ -265,11 +481,14 @@ class Loader : public ProcessDelegate, public VMemoryDelegate {
       picojson::object packet;
       packet.insert(std::make_pair("command", picojson::value(std::string("warp_thread"))));
       packet.insert(std::make_pair("pid", Convert::vpid2json(in_pid)));
-      packet.insert(std::make_pair("root_tid", Convert::vtid2json(proc->root_tid)));
-      packet.insert(std::make_pair("proc_addr", Convert::vaddr2json(proc->addr)));
+      packet.insert(std::make_pair("root_tid", Convert::vtid2json(proc.root_tid)));
+      packet.insert(std::make_pair("proc_addr", Convert::vaddr2json(proc.addr)));
       packet.insert(std::make_pair("master_nid", Convert::nid2json(NID::SERVER)));
       packet.insert(std::make_pair("name", picojson::value(in_name)));
-      packet.insert(std::make_pair("tid", Convert::vtid2json(proc->root_tid)));
+      if (!in_image_path.empty()) {
+        packet.insert(std::make_pair("image", picojson::value(in_image_path)));
+      }
+      packet.insert(std::make_pair("tid", Convert::vtid2json(proc.root_tid)));
       packet.insert(std::make_pair("dst_nid", Convert::nid2json(in_dst_nid)));
       packet.insert(std::make_pair("src_nid", Convert::nid2json(in_src_nid)));
       packet.insert(std::make_pair("src_account", picojson::value(in_src_account)));
@@ -278,21 +497,22 @@ class Loader : public ProcessDelegate, public VMemoryDelegate {
     body.insert(std::make_pair("sched_packet", picojson::value(js_sched_packet)));
 
     picojson::array js_memory_packet;
-    for (auto& it : vmemory.get_space(Convert::vpid2str(in_pid)).pages) {
-      // Don't export builtin variables.
-      if (proc->builtin_addrs.find(it.first) != proc->builtin_addrs.end()) {
-        continue;
-      }
+    if (in_image_path.empty()) {
+      for (auto& it : vmemory.get_space(Convert::vpid2str(in_pid)).pages) {
+        // Don't export builtin variables.
+        if (proc.builtin_addrs.find(it.first) != proc.builtin_addrs.end()) {
+          continue;
+        }
 
-      picojson::object packet;
-      packet.insert(std::make_pair("command", picojson::value(std::string("give"))));
-      packet.insert(std::make_pair("addr", Convert::vaddr2json(it.first)));
-      packet.insert(std::make_pair("value",
-                                   Convert::bin2json(it.second.value.get(), it.second.size)));
-      packet.insert(std::make_pair("dst_nid", Convert::nid2json(in_dst_nid)));
-      packet.insert(std::make_pair("src_nid", Convert::nid2json(NID::SERVER)));
-      packet.insert(std::make_pair("hint_nid", picojson::value(picojson::array())));
-      js_memory_packet.push_back(picojson::value(picojson::value(packet).serialize()));
+        picojson::object packet;
+        packet.insert(std::make_pair("command", picojson::value(std::string("give"))));
+        packet.insert(std::make_pair("addr", Convert::vaddr2json(it.first)));
+        VMemory::value2json(packet, it.second.value, 0, it.second.size);
+        packet.insert(std::make_pair("dst_nid", Convert::nid2json(in_dst_nid)));
+        packet.insert(std::make_pair("src_nid", Convert::nid2json(NID::SERVER)));
+        packet.insert(std::make_pair("hint_nid", picojson::value(picojson::array())));
+        js_memory_packet.push_back(picojson::value(picojson::value(packet).serialize()));
+      }
     }
     body.insert(std::make_pair("memory_packet", picojson::value(js_memory_packet)));
 
@@ -0,0 +1,109 @@
+
+#include <initializer_list>
+
+#include "constant_vm.hpp"
+#include "migration_policy.hpp"
+
+namespace processwarp {
+
+// Constructor, all counters are zero.
+PageStats::PageStats() :
+    local_access(0),
+    copies_since_access(0),
+    streak(0),
+    gives(0),
+    window_begin(std::time(nullptr)),
+    referenced(true) {
+}
+
+// Record a copy received from master node.
+void PageStats::record_copy() {
+  roll();
+  copies_since_access++;
+}
+
+// Record an update command from another node.
+void PageStats::record_remote_write(const nid_t& nid) {
+  roll();
+  remote_writes[nid]++;
+  if (streak != 0 && streak_nid == nid) {
+    streak++;
+  } else {
+    streak_nid = nid;
+    streak = 1;
+  }
+}
+
+// Record a require command from another node.
+void PageStats::record_remote_read(const nid_t& nid) {
+  roll();
+  remote_reads[nid]++;
+  if (streak != 0 && streak_nid != nid) streak = 0;
+}
+
+// Record giving master flag to another node.
+void PageStats::record_give() {
+  roll();
+  gives++;
+  streak = 0;
+  remote_reads.clear();
+}
+
+/**
+ * Halve counters for each window elapsed since the current window began.
+ */
+void PageStats::roll() {
+  std::time_t now = std::time(nullptr);
+  if (now < window_begin + VMemoryMigration::WINDOW) return;
+
+  std::time_t windows = (now - window_begin) / VMemoryMigration::WINDOW;
+  window_begin += windows * VMemoryMigration::WINDOW;
+  unsigned int shift = windows < 32 ? static_cast<unsigned int>(windows) : 31;
+
+  local_access >>= shift;
+  gives >>= shift;
+  for (auto* counts : {&remote_writes, &remote_reads}) {
+    for (auto it = counts->begin(); it != counts->end();) {
+      it->second >>= shift;
+      if (it->second == 0) {
+        it = counts->erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+}
+
+MigrationPolicy::~MigrationPolicy() {
+}
+
+// Give master flag after consecutive writes by the node if the page isn't pinned.
+bool DefaultMigrationPolicy::should_give_on_write(const PageStats& stats, const nid_t& nid) {
+  return stats.gives < VMemoryMigration::PIN_GIVES &&
+      stats.streak_nid == nid && stats.streak >= VMemoryMigration::WRITE_STREAK;
+}
+
+// Give master flag to the heaviest reader if the page isn't used in this node.
+bool DefaultMigrationPolicy::should_give_on_read(const PageStats& stats, const nid_t& nid) {
+  if (stats.local_access != 0 || stats.gives >= VMemoryMigration::PIN_GIVES ||
+      !stats.remote_writes.empty()) {
+    return false;
+  }
+
+  uint32_t count = 0;
+  uint32_t others = 0;
+  for (auto& it : stats.remote_reads) {
+    if (it.first == nid) {
+      count = it.second;
+    } else {
+      others += it.second;
+    }
+  }
+  return count >= VMemoryMigration::READ_LIMIT && count > others;
+}
+
+// Keep copy while it is read in this node, drop idle copy updated many times.
+bool DefaultMigrationPolicy::should_keep_copy(const PageStats& stats) {
+  return stats.local_access != 0 || stats.copies_since_access < VMemoryMigration::COPY_LIMIT;
+}
+}  // namespace processwarp
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+
+#include "type.hpp"
+
+namespace processwarp {
+/**
+ * Access statistics of a page collected by VMemory.
+ * Counters are halved every window to prefer recent accesses.
+ */
+struct PageStats {
+  /** Count of accesses by threads in this node. */
+  uint32_t local_access;
+  /** Count of copies received since last access by this node. */
+  uint32_t copies_since_access;
+  /** Count of update commands from each node. */
+  std::map<nid_t, uint32_t> remote_writes;
+  /** Count of require commands from each node. */
+  std::map<nid_t, uint32_t> remote_reads;
+  /** Node-id wrote the page at last without access by another node. */
+  nid_t streak_nid;
+  /** Count of consecutive writes by streak_nid. */
+  uint32_t streak;
+  /** Count of giving master flag from this node. */
+  uint32_t gives;
+  /** Time the current window began. */
+  std::time_t window_begin;
+  /** Reference bit for CLOCK eviction of copy, set by access and cleared by eviction scan. */
+  bool referenced;
+
+  PageStats();
+
+  /**
+   * Record an access by a thread in this node.
+   * This is called for every access, so only counters are changed.
+   */
+  void record_local() {
+    local_access++;
+    copies_since_access = 0;
+    streak = 0;
+    referenced = true;
+  }
+
+  void record_copy();
+  void record_remote_write(const nid_t& nid);
+  void record_remote_read(const nid_t& nid);
+  void record_give();
+
+ private:
+  void roll();
+};
+
+/**
+ * Interface of policy to decide moving master flag or copy of a page.
+ */
+class MigrationPolicy {
+ public:
+  virtual ~MigrationPolicy();
+
+  /**
+   * Decide to give master flag to a node updated the page.
+   * @param stats Statistics of the page in master node.
+   * @param nid Node-id sent update command.
+   * @return True if master flag should be given to the node.
+   */
+  virtual bool should_give_on_write(const PageStats& stats, const nid_t& nid) = 0;
+
+  /**
+   * Decide to give master flag to a node required the page.
+   * @param stats Statistics of the page in master node.
+   * @param nid Node-id sent require command.
+   * @return True if master flag should be given to the node.
+   */
+  virtual bool should_give_on_read(const PageStats& stats, const nid_t& nid) = 0;
+
+  /**
+   * Decide to keep copy of the page when a copy is received.
+   * @param stats Statistics of the page in copy node.
+   * @return True if the copy should be kept, otherwise unwant command is sent.
+   */
+  virtual bool should_keep_copy(const PageStats& stats) = 0;
+};
+
+/**
+ * Default policy.
+ * Master flag moves to a node wrote the page consecutively, or to a node that is the heaviest
+ * reader of the page unused in master node. Pages gave master flag frequently are pinned to stop
+ * ping-pong. Copy is kept while it is read in the window.
+ */
+class DefaultMigrationPolicy : public MigrationPolicy {
+ public:
+  bool should_give_on_write(const PageStats& stats, const nid_t& nid) override;
+  bool should_give_on_read(const PageStats& stats, const nid_t& nid) override;
+  bool should_keep_copy(const PageStats& stats) override;
+};
+}  // namespace processwarp
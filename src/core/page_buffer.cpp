@@ -0,0 +1,251 @@
+
+#if !defined(EMSCRIPTEN) && (defined(__linux__) || defined(__APPLE__))
+#  define PW_PAGE_BUFFER_MMAP
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include "constant_vm.hpp"
+#include "page_buffer.hpp"
+
+namespace processwarp {
+/** Shared area filled by zero to read small zero buffers. */
+static uint8_t zero_area[VMemoryChunk::SIZE];
+
+/**
+ * Check all bytes in a area are zero.
+ * @param data Pointer to the area.
+ * @param length Length of the area.
+ * @return True if all bytes are zero.
+ */
+static bool is_zero_area(const uint8_t* data, uint64_t length) {
+  const uint8_t* it = data;
+  const uint8_t* end = data + length;
+  for (; it != end && reinterpret_cast<uintptr_t>(it) % sizeof(uint64_t) != 0; it++) {
+    if (*it != 0) return false;
+  }
+  for (; end - it >= static_cast<std::ptrdiff_t>(sizeof(uint64_t)); it += sizeof(uint64_t)) {
+    if (*reinterpret_cast<const uint64_t*>(it) != 0) return false;
+  }
+  for (; it != end; it++) {
+    if (*it != 0) return false;
+  }
+  return true;
+}
+
+// Constructor, make empty buffer.
+PageBuffer::PageBuffer() :
+    ptr(nullptr),
+    size(0),
+    is_mapped(false),
+    refs(nullptr) {
+}
+
+// Move constructor.
+PageBuffer::PageBuffer(PageBuffer&& src) :
+    ptr(src.ptr),
+    size(src.size),
+    is_mapped(src.is_mapped),
+    refs(src.refs) {
+  src.ptr = nullptr;
+  src.size = 0;
+  src.is_mapped = false;
+  src.refs = nullptr;
+}
+
+// Release buffer.
+PageBuffer::~PageBuffer() {
+  reset();
+}
+
+// Move operator.
+PageBuffer& PageBuffer::operator=(PageBuffer&& src) {
+  reset();
+  swap(src);
+  return *this;
+}
+
+// Get pointer to the buffer to read.
+const uint8_t* PageBuffer::get_readonly() {
+  if (ptr == nullptr && size != 0) {
+    if (size <= sizeof(zero_area)) return zero_area;
+    materialize();
+  }
+  return ptr;
+}
+
+// Check a range is filled by zero.
+bool PageBuffer::is_zero(uint64_t offset, uint64_t length) const {
+  assert(offset + length <= size);
+  return ptr == nullptr || is_zero_area(ptr + offset, length);
+}
+
+// Write data into a range, storage is not allocated if the buffer and data are zero.
+void PageBuffer::store(uint64_t offset, const uint8_t* data, uint64_t length) {
+  assert(offset + length <= size);
+  if (ptr == nullptr && is_zero_area(data, length)) return;
+  std::memmove(get() + offset, data, length);
+}
+
+// Make a new buffer filled by zero without storage, previous buffer is released.
+void PageBuffer::allocate(uint64_t size_) {
+  reset();
+  size = size_;
+}
+
+// Release buffer.
+void PageBuffer::reset() {
+  // Storage is released by the last buffer sharing it.
+  if (refs != nullptr) {
+    if (--*refs != 0) {
+      ptr = nullptr;
+    } else {
+      delete refs;
+    }
+    refs = nullptr;
+  }
+
+  if (ptr != nullptr) {
+#ifdef PW_PAGE_BUFFER_MMAP
+    if (is_mapped) {
+      munmap(ptr, size);
+    } else {
+      delete[] ptr;
+    }
+#else
+    delete[] ptr;
+#endif
+  }
+
+  ptr = nullptr;
+  size = 0;
+  is_mapped = false;
+}
+
+// Change size of buffer keeping value, extended range is filled by zero.
+void PageBuffer::resize(uint64_t size_) {
+  if (size_ == size) return;
+
+  if (ptr == nullptr) {
+    size = size_;
+    return;
+  }
+
+  // Counter is left after other buffers sharing the storage are released.
+  if (refs != nullptr && *refs == 1) unshare();
+
+#if defined(PW_PAGE_BUFFER_MMAP) && defined(__linux__)
+  if (is_mapped && refs == nullptr && size_ >= VMemoryBuffer::MMAP_THRESHOLD) {
+    void* mapped = mremap(ptr, size, size_, MREMAP_MAYMOVE);
+    if (mapped == MAP_FAILED) throw std::bad_alloc();
+    // Bytes after old size in the last memory page may be dirty, other pages are new zero pages.
+    if (size_ > size) {
+      uint64_t page_size = sysconf(_SC_PAGESIZE);
+      uint64_t dirty_end = std::min(size_, (size + page_size - 1) / page_size * page_size);
+      std::memset(reinterpret_cast<uint8_t*>(mapped) + size, 0, dirty_end - size);
+    }
+    ptr = reinterpret_cast<uint8_t*>(mapped);
+    size = size_;
+    return;
+  }
+#endif
+
+  PageBuffer tmp;
+  tmp.allocate(size_);
+  if (size_ != 0) {
+    std::memcpy(tmp.get(), ptr, std::min(size, size_));
+  }
+  swap(tmp);
+}
+
+// Fill a range by zero.
+void PageBuffer::fill_zero(uint64_t offset, uint64_t length) {
+  assert(offset + length <= size);
+  if (ptr == nullptr) return;
+
+  // Release storage if whole of buffer is filled.
+  if (offset == 0 && length == size) {
+    allocate(size);
+    return;
+  }
+  if (refs != nullptr) unshare();
+
+#if defined(PW_PAGE_BUFFER_MMAP) && defined(__linux__)
+  // Anonymous private mapping returns zero page after MADV_DONTNEED on Linux.
+  if (is_mapped) {
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t begin = (offset + page_size - 1) / page_size * page_size;
+    uint64_t end = (offset + length) / page_size * page_size;
+    if (begin < end) {
+      std::memset(ptr + offset, 0, begin - offset);
+      madvise(ptr + begin, end - begin, MADV_DONTNEED);
+      std::memset(ptr + end, 0, offset + length - end);
+      return;
+    }
+  }
+#endif
+
+  std::memset(ptr + offset, 0, length);
+}
+
+// Allocate storage filled by zero for zero buffer.
+void PageBuffer::materialize() {
+  assert(ptr == nullptr && size != 0);
+
+#ifdef PW_PAGE_BUFFER_MMAP
+  if (size >= VMemoryBuffer::MMAP_THRESHOLD) {
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) throw std::bad_alloc();
+    ptr = reinterpret_cast<uint8_t*>(mapped);
+    is_mapped = true;
+    return;
+  }
+#endif
+
+  ptr = new uint8_t[size]();
+}
+
+// Make another buffer sharing storage with this buffer.
+PageBuffer PageBuffer::share() {
+  PageBuffer other;
+  other.size = size;
+  if (ptr != nullptr) {
+    if (refs == nullptr) refs = new int(1);
+    (*refs)++;
+    other.ptr = ptr;
+    other.is_mapped = is_mapped;
+    other.refs = refs;
+  }
+  return other;
+}
+
+// Swap buffer with another instance.
+void PageBuffer::swap(PageBuffer& other) {
+  std::swap(ptr, other.ptr);
+  std::swap(size, other.size);
+  std::swap(is_mapped, other.is_mapped);
+  std::swap(refs, other.refs);
+}
+
+// Take own storage for shared buffer, storage is copied if another buffer uses it.
+void PageBuffer::unshare() {
+  assert(ptr != nullptr && refs != nullptr);
+  if (*refs == 1) {
+    delete refs;
+    refs = nullptr;
+    return;
+  }
+
+  PageBuffer tmp;
+  tmp.allocate(size);
+  std::memcpy(tmp.get(), ptr, size);
+  swap(tmp);
+}
+}  // namespace processwarp
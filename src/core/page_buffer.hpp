@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+
+namespace processwarp {
+/**
+ * Storage of page value.
+ * Small buffer is allocated from heap, large buffer is mapped by anonymous mmap (if it is
+ * supported) to leave untouched ranges as kernel zero pages and to grow by mremap.
+ * A buffer filled by zero is kept without storage until it is required to write.
+ * Storage can be shared by some buffers, it is copied when one of them is written.
+ */
+class PageBuffer {
+ public:
+  /**
+   * Constructor, make empty buffer.
+   */
+  PageBuffer();
+
+  /**
+   * Move constructor.
+   */
+  PageBuffer(PageBuffer&& src);
+
+  /**
+   * Release buffer.
+   */
+  ~PageBuffer();
+
+  /**
+   * Move operator.
+   */
+  PageBuffer& operator=(PageBuffer&& src);
+
+  /**
+   * Get pointer to the buffer to write, storage is allocated if the buffer is zero.
+   * @return Pointer, or nullptr if buffer is empty.
+   */
+  uint8_t* get() {
+    if (ptr == nullptr && size != 0) {
+      materialize();
+    } else if (refs != nullptr) {
+      unshare();
+    }
+    return ptr;
+  }
+
+  /**
+   * Get pointer to the buffer to read.
+   * Shared zero area is returned without allocating storage if the buffer is small and zero.
+   * @return Pointer, or nullptr if buffer is empty.
+   */
+  const uint8_t* get_readonly();
+
+  /**
+   * Check a range is filled by zero.
+   * @param offset Begin of range.
+   * @param length Length of range.
+   * @return True if all bytes in the range are zero.
+   */
+  bool is_zero(uint64_t offset, uint64_t length) const;
+
+  /**
+   * Write data into a range, storage is not allocated if the buffer and data are zero.
+   * Source and destination may overlap.
+   * @param offset Begin of range.
+   * @param data Pointer to data.
+   * @param length Length of data.
+   */
+  void store(uint64_t offset, const uint8_t* data, uint64_t length);
+
+  /**
+   * Make a new buffer filled by zero without storage, previous buffer is released.
+   * @param size Size of buffer.
+   */
+  void allocate(uint64_t size);
+
+  /**
+   * Release buffer.
+   */
+  void reset();
+
+  /**
+   * Change size of buffer keeping value, extended range is filled by zero.
+   * @param size New size of buffer.
+   */
+  void resize(uint64_t size);
+
+  /**
+   * Fill a range by zero.
+   * Whole memory pages in the range are returned to kernel for mapped buffer.
+   * @param offset Begin of range.
+   * @param length Length of range.
+   */
+  void fill_zero(uint64_t offset, uint64_t length);
+
+  /**
+   * Make another buffer sharing storage with this buffer.
+   * @return A buffer having same value, storage is copied when one of buffers is written.
+   */
+  PageBuffer share();
+
+  /**
+   * Check storage is shared with another buffer.
+   * @return True if storage is shared.
+   */
+  bool is_shared() const {
+    return refs != nullptr && *refs > 1;
+  }
+
+  /**
+   * Swap buffer with another instance.
+   * @param other Another buffer.
+   */
+  void swap(PageBuffer& other);
+
+ private:
+  /** Pointer to the buffer, nullptr if the buffer is empty or zero. */
+  uint8_t* ptr;
+  /** Size of the buffer. */
+  uint64_t size;
+  /** True if the buffer is mapped by mmap. */
+  bool is_mapped;
+  /** Count of buffers sharing the storage, nullptr if the storage isn't shared. */
+  int* refs;
+
+  /**
+   * Allocate storage filled by zero for zero buffer.
+   */
+  void materialize();
+
+  /**
+   * Take own storage for shared buffer, storage is copied if another buffer uses it.
+   */
+  void unshare();
+
+  /** Block copy constructor. */
+  PageBuffer(const PageBuffer&);
+
+  /** Block copy operator. */
+  PageBuffer& operator=(const PageBuffer&);
+};
+}  // namespace processwarp
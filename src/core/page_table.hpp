@@ -0,0 +1,265 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "type.hpp"
+
+namespace processwarp {
+/**
+ * Page table keyed by upper address.
+ * Open addressing hash table with linear probing. Each entry is allocated separately, so
+ * pointers to values are kept while the entry is in the table (even over a rehash).
+ * Erasing leaves a tombstone and never rehashes, so it is safe to erase while iterating.
+ */
+template <typename V> class PageTable {
+ public:
+  typedef std::pair<const vaddr_t, V> value_type;
+
+ private:
+  /** Slot of table. A tombstone is a slot that is empty but was used. */
+  struct Slot {
+    std::unique_ptr<value_type> entry;
+    bool tombstone;
+
+    Slot() : tombstone(false) {
+    }
+  };
+
+ public:
+  /** Forward iterator over used slots. */
+  class iterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef PageTable::value_type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef value_type* pointer;
+    typedef value_type& reference;
+
+    iterator() : slots(nullptr), idx(0) {
+    }
+
+    iterator(std::vector<Slot>* slots_, size_t idx_) : slots(slots_), idx(idx_) {
+      skip();
+    }
+
+    value_type& operator*() const {
+      return *(*slots)[idx].entry;
+    }
+
+    value_type* operator->() const {
+      return (*slots)[idx].entry.get();
+    }
+
+    iterator& operator++() {
+      idx++;
+      skip();
+      return *this;
+    }
+
+    iterator operator++(int) {
+      iterator tmp(*this);
+      ++(*this);
+      return tmp;
+    }
+
+    bool operator==(const iterator& rhs) const {
+      return idx == rhs.idx;
+    }
+
+    bool operator!=(const iterator& rhs) const {
+      return idx != rhs.idx;
+    }
+
+    /**
+     * Get slot position of the entry, usable to resume a scan by find_from.
+     * @return Slot position.
+     */
+    size_t get_position() const {
+      return idx;
+    }
+
+   private:
+    friend class PageTable;
+    std::vector<Slot>* slots;
+    size_t idx;
+
+    void skip() {
+      while (idx < slots->size() && !(*slots)[idx].entry) idx++;
+    }
+  };
+
+  /**
+   * Constructor, make empty table.
+   */
+  PageTable() :
+      slots(INITIAL_CAPACITY),
+      used(0),
+      tombstones(0),
+      generation(0) {
+  }
+
+  iterator begin() {
+    return iterator(&slots, 0);
+  }
+
+  iterator end() {
+    return iterator(&slots, slots.size());
+  }
+
+  size_t size() const {
+    return used;
+  }
+
+  bool empty() const {
+    return used == 0;
+  }
+
+  /**
+   * Find an entry by address.
+   * @param key Upper address.
+   * @return Iterator to the entry, or end() if not exist.
+   */
+  iterator find(vaddr_t key) {
+    size_t idx = lookup(key);
+    return idx == NPOS ? end() : iterator(&slots, idx);
+  }
+
+  /**
+   * Get iterator to the first entry at or after a slot position.
+   * Position is not stable over a rehash, so use this only to resume an approximate scan.
+   * @param pos Slot position got by iterator::get_position.
+   * @return Iterator to the entry, or end() if there is no entry after the position.
+   */
+  iterator find_from(size_t pos) {
+    return iterator(&slots, pos < slots.size() ? pos : slots.size());
+  }
+
+  /**
+   * Insert an entry if the address is not used yet.
+   * @param pair Pair of address and value.
+   * @return Pair of iterator to the entry and true if it was inserted.
+   */
+  std::pair<iterator, bool> insert(std::pair<vaddr_t, V>&& pair) {
+    size_t idx = lookup(pair.first);
+    if (idx != NPOS) return std::make_pair(iterator(&slots, idx), false);
+
+    if ((used + tombstones + 1) * 4 > slots.size() * 3) {
+      rehash(used * 2 + 1 > slots.size() / 2 ? slots.size() * 2 : slots.size());
+    }
+
+    size_t mask = slots.size() - 1;
+    for (idx = hash(pair.first) & mask; slots[idx].entry; idx = (idx + 1) & mask) {}
+    if (slots[idx].tombstone) {
+      slots[idx].tombstone = false;
+      tombstones--;
+    }
+    slots[idx].entry.reset(new value_type(pair.first, std::move(pair.second)));
+    used++;
+    return std::make_pair(iterator(&slots, idx), true);
+  }
+
+  /**
+   * Erase an entry by address.
+   * @param key Upper address.
+   * @return Number of erased entries (0 or 1).
+   */
+  size_t erase(vaddr_t key) {
+    size_t idx = lookup(key);
+    if (idx == NPOS) return 0;
+    erase_slot(idx);
+    return 1;
+  }
+
+  /**
+   * Erase an entry pointed by iterator.
+   * @param it Iterator to the entry.
+   * @return Iterator to the next entry.
+   */
+  iterator erase(iterator it) {
+    erase_slot(it.idx);
+    return ++it;
+  }
+
+  /**
+   * Erase all entries.
+   */
+  void clear() {
+    std::vector<Slot>(INITIAL_CAPACITY).swap(slots);
+    used = 0;
+    tombstones = 0;
+    generation++;
+  }
+
+  /**
+   * Get the counter that is increased every time an entry is erased.
+   * A pointer to a value got from this table is valid while this value is not changed.
+   * @return Generation counter.
+   */
+  uint64_t get_generation() const {
+    return generation;
+  }
+
+ private:
+  static const size_t INITIAL_CAPACITY = 64;
+  static const size_t NPOS = static_cast<size_t>(-1);
+
+  /** Slots, the size is always power of 2. */
+  std::vector<Slot> slots;
+  /** Count of used slots. */
+  size_t used;
+  /** Count of tombstone slots. */
+  size_t tombstones;
+  /** Counter increased on erase. */
+  uint64_t generation;
+
+  /**
+   * Hash function for address.
+   * Lower bits of upper address are zero in many case, so mix all bits (splitmix64 finalizer).
+   */
+  static size_t hash(vaddr_t key) {
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+    return static_cast<size_t>(key ^ (key >> 31));
+  }
+
+  size_t lookup(vaddr_t key) const {
+    size_t mask = slots.size() - 1;
+    for (size_t idx = hash(key) & mask; ; idx = (idx + 1) & mask) {
+      const Slot& slot = slots[idx];
+      if (slot.entry) {
+        if (slot.entry->first == key) return idx;
+      } else if (!slot.tombstone) {
+        return NPOS;
+      }
+    }
+  }
+
+  void erase_slot(size_t idx) {
+    assert(slots[idx].entry);
+    slots[idx].entry.reset();
+    slots[idx].tombstone = true;
+    used--;
+    tombstones++;
+    generation++;
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<Slot> old(capacity);
+    old.swap(slots);
+    tombstones = 0;
+
+    size_t mask = slots.size() - 1;
+    for (auto& slot : old) {
+      if (!slot.entry) continue;
+      size_t idx = hash(slot.entry->first) & mask;
+      while (slots[idx].entry) idx = (idx + 1) & mask;
+      slots[idx].entry = std::move(slot.entry);
+    }
+  }
+};
+}  // namespace processwarp
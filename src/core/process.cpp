@@ -101,6 +101,8 @@ Process::Process(ProcessDelegate& delegate_,
     libs(libs_),
     lib_filter(lib_filter_),
     builtin_funcs(builtin_funcs_) {
+  warp_batch.dst_nid = NID::NONE;
+  warp_batch.time = 0;
 }
 
 // Allocate process on memory from delegate.
@@ -510,23 +512,32 @@ re_entry: {
         } break;
 
         case Opcode::CMPXCHG: {
-          /// @todo cmpxchg needs lock
-          // memory.lock_master(stackinfo.output);
-          // memory.lock_master(stackinfo.address);
-
-          bool is_eq = stackinfo.type_operator->is_equal(stackinfo.address, stackinfo.value);
-
-          if (is_eq) {
-            // *a == vを満たす場合、値を書き換え＆書き換え成功フラグを設定
-            stackinfo.type_operator->copy_value(stackinfo.output, stackinfo.address);
-            memory.write<uint8_t>(stackinfo.output + stackinfo.type_store->size, 1);
-            stackinfo.type_operator->copy_value(stackinfo.address, get_operand(code, op_param));
+          // Compare and exchange is executed by master of the page at once.
+          uint64_t size = stackinfo.type_store->size;
+          std::string compare(reinterpret_cast<const char*>(memory.read_raw(stackinfo.value)),
+                              size);
+          std::string old = memory.atomic(
+              stackinfo.address, VMemory::AT_CMPXCHG,
+              std::string(reinterpret_cast<const char*>(
+                  memory.read_raw(get_operand(code, op_param))), size),
+              compare);
+          memory.write_copy(stackinfo.output, reinterpret_cast<const uint8_t*>(old.data()), size);
+          memory.write<uint8_t>(stackinfo.output + size, old == compare ? 1 : 0);
+          memory.finish_atomic();
+        } break;
 
-          } else {
-            // *a != vの場合、書き換え成功フラグをリセット
-            stackinfo.type_operator->copy_value(stackinfo.output, stackinfo.address);
-            memory.write<uint8_t>(stackinfo.output + stackinfo.type_store->size, 0);
-          }
+        case Opcode::ATOMIC: {
+          // Read-modify-write is executed by master of the page, output is old value.
+          uint64_t size = stackinfo.type_store->size;
+          VMemory::AtomicType type =
+              static_cast<VMemory::AtomicType>(Instruction::get_operand_value(code));
+          std::string old = memory.atomic(
+              stackinfo.address, type,
+              std::string(reinterpret_cast<const char*>(memory.read_raw(stackinfo.value)), size),
+              std::string());
+          memory.write_copy(stackinfo.output, reinterpret_cast<const uint8_t*>(old.data()), size);
+          memory.finish_atomic();
+          Logger::dbg_vm(CoreMid::L1001, "atomic %d *%016" PRIx64, type, stackinfo.address);
         } break;
 
         case Opcode::ALLOCA: {
@@ -1066,6 +1077,18 @@ void Process::warp_out_thread(vtid_t tid) {
   }
 }
 
+// Warp out threads warped together.
+void Process::warp_out_threads(const std::set<vtid_t>& tids) {
+  for (auto tid : tids) {
+    if (waiting_warp_result.find(tid) == waiting_warp_result.end()) {
+      active_threads.insert(tid);
+      waiting_warp_setup.insert(tid);
+    }
+  }
+  // Tell even if threads are active already, the source waits for it to finish warp.
+  delegate.process_change_thread_set(*this);
+}
+
 // Create a new thread.
 vtid_t Process::create_thread(vaddr_t func_addr, vaddr_t arg_addr) {
   std::unique_ptr<FuncStore> func(FuncStore::read(*this, *proc_memory, func_addr));
@@ -1340,7 +1363,8 @@ void Process::run(const std::vector<std::string>& args,
       for (auto pair : envs) {
         vaddr_t addr = root_stack + sum;
         memory.write<vaddr_t>(root_stack + arg_size + sizeof(vaddr_t) * i, addr);
-        sum += snprintf(reinterpret_cast<char*>(memory.read_writable(root_stack + sum)),
+        sum += snprintf(reinterpret_cast<char*>(memory.read_writable(root_stack + sum,
+                                                                     root_stack_size - sum)),
                         root_stack_size - sum,
                         "%s=%s", pair.first.c_str(), pair.second.c_str()) + 1;
         i++;
@@ -43,6 +43,45 @@ class Process {
   /** 終了処理時に呼び出す関数一覧 */
   typedef std::stack<vaddr_t> CallsAtExit;
 
+  /** State of pre-copy before warp of a thread. */
+  struct Precopy {
+    /** Warp destination node-id. */
+    nid_t dst_nid;
+    /** Pages sent to the destination. */
+    std::set<vaddr_t> sent;
+    /** Count of rounds done. */
+    unsigned int round;
+    /** Time of last round (msec). */
+    uint64_t time;
+    /** True if the thread was required to warp after rounds. */
+    bool is_required;
+  };
+
+  /** State of warp of threads in this node together to the same node. */
+  struct WarpBatch {
+    /** Warp destination node-id, NONE if no batch is running. */
+    nid_t dst_nid;
+    /** Threads warped by the batch. */
+    std::set<vtid_t> tids;
+    /** Threads stopped at safe point. */
+    std::set<vtid_t> ready;
+    /** Pages sent to the destination by pre-copy of the threads before the batch. */
+    std::set<vaddr_t> precopied;
+    /** Parameters of give sent by warp_process command, kept to resend. */
+    picojson::array bundle;
+    /** Time sent warp_process command (msec), 0 if not sent yet. */
+    uint64_t time;
+  };
+
+  /** Count and time of waiting memory for a thread. */
+  struct StallStats {
+    uint64_t count;
+    /** Total time of waiting (msec). */
+    uint64_t time;
+    /** Time began to wait (msec), 0 if not waiting now. */
+    uint64_t since;
+  };
+
   /** Deleagetr. */
   ProcessDelegate& delegate;
   /** Accessotr to binded memory. */
@@ -73,11 +112,19 @@ class Process {
 
   /** Thread-ids waiting to get memory data and create instance on warp phase. (not dump) */
   std::set<vtid_t> waiting_warp_setup;
-  /** Thread-ids and timestamp waiting to dealt with on warp phase. (not dump) */
-  std::map<vtid_t, std::time_t> waiting_warp_result;
+  /** Thread-ids and timestamp (msec) waiting to dealt with on warp phase. (not dump) */
+  std::map<vtid_t, uint64_t> waiting_warp_result;
+  /** Pages given with warp of each thread, kept to resend until the warp is reported. (not dump) */
+  std::map<vtid_t, picojson::array> warp_bundles;
+  /** Thread-ids and state of pre-copy running before warp. (not dump) */
+  std::map<vtid_t, Precopy> precopies;
+  /** State of warp of threads together. (not dump) */
+  WarpBatch warp_batch;
 
   /** Memory addres waiting to update by other node. (not dump) */
   std::map<vtid_t, vaddr_t> waiting_addr;
+  /** Statistics of waiting memory for each thread. (not dump) */
+  std::map<vtid_t, StallStats> stalls;
 
   /**
    * Allocate process on memory from delegate.
@@ -160,6 +207,13 @@ class Process {
    */
   void warp_out_thread(vtid_t tid);
 
+  /**
+   * Warp out threads warped together.
+   * Activate threads and tell thread set is changed once.
+   * @param tids Thread-ids to activate.
+   */
+  void warp_out_threads(const std::set<vtid_t>& tids);
+
   /**
    * Create a new thread and activate.
    * @param func_addr Entry point for new thread.
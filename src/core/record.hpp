@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "error.hpp"
+#include "type.hpp"
+
+namespace processwarp {
+/**
+ * Writer of binary record stored in meta area.
+ * Values are written by fixed width in the byte order of this node, same as page values.
+ */
+class RecordWriter {
+ public:
+  /**
+   * Append a value.
+   * @param value Value to append.
+   * @return This writer.
+   */
+  template <typename T> RecordWriter& put(T value) {
+    data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    return *this;
+  }
+
+  /**
+   * Append count and addresses.
+   * @param addrs Addresses to append.
+   * @return This writer.
+   */
+  RecordWriter& put_vector(const std::vector<vaddr_t>& addrs) {
+    put<uint32_t>(static_cast<uint32_t>(addrs.size()));
+    if (!addrs.empty()) {
+      data.append(reinterpret_cast<const char*>(addrs.data()), addrs.size() * sizeof(vaddr_t));
+    }
+    return *this;
+  }
+
+  /**
+   * Get written record.
+   * @return Record.
+   */
+  std::string& get() {
+    return data;
+  }
+
+ private:
+  /** Written record. */
+  std::string data;
+};
+
+/**
+ * Reader of binary record written by RecordWriter.
+ */
+class RecordReader {
+ public:
+  /**
+   * Constructor with record.
+   * @param data_ Record, it must be kept while reading.
+   */
+  explicit RecordReader(const std::string& data_) :
+      data(data_),
+      pos(0) {
+  }
+
+  /**
+   * Read a value.
+   * @return Value.
+   */
+  template <typename T> T get() {
+    T value;
+    check(sizeof(T));
+    std::memcpy(&value, data.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return value;
+  }
+
+  /**
+   * Skip bytes.
+   * @param length Count of bytes to skip.
+   */
+  void skip(size_t length) {
+    check(length);
+    pos += length;
+  }
+
+  /**
+   * Read count and addresses.
+   * @return Addresses.
+   */
+  std::vector<vaddr_t> get_vector() {
+    uint32_t count = get<uint32_t>();
+    check(count * sizeof(vaddr_t));
+    std::vector<vaddr_t> addrs(count);
+    if (count != 0) {
+      std::memcpy(addrs.data(), data.data() + pos, count * sizeof(vaddr_t));
+    }
+    pos += count * sizeof(vaddr_t);
+    return addrs;
+  }
+
+ private:
+  /** Reading record. */
+  const std::string& data;
+  /** Position to read next. */
+  size_t pos;
+
+  /**
+   * Check the record has bytes to read.
+   * Record can be broken if the page was written by another program or truncated.
+   * @param length Count of bytes to read.
+   */
+  void check(size_t length) {
+    if (length > data.size() || pos > data.size() - length) {
+      throw_error_message(Error::PARSE, "record is broken");
+    }
+  }
+};
+}  // namespace processwarp
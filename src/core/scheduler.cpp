@@ -14,6 +14,7 @@
 #include "core_mid.hpp"
 #include "logger.hpp"
 #include "scheduler.hpp"
+#include "trace.hpp"
 
 namespace processwarp {
 /**
@@ -126,6 +127,12 @@ void Scheduler::recv_command(const CommandPacket& packet) {
   } else if (command == "warp_gui") {
     recv_command_warp_gui(packet);
 
+  } else if (command == "warp_precopy") {
+    recv_command_warp_precopy(packet);
+
+  } else if (command == "warp_process") {
+    recv_command_warp_process(packet);
+
   } else if (command == "warp_thread") {
     recv_command_warp_thread(packet);
 
@@ -169,6 +176,8 @@ void Scheduler::execute() {
   // Cleanup unresponsive module.
   cleanup_unresponsive_process();
   cleanup_unresponsive_node();
+
+  retry_deferred_warp();
 }
 
 /**
@@ -225,10 +234,111 @@ void Scheduler::cleanup_unresponsive_process() {
   }
 }
 
+/**
+ * Count threads running in each node, used as load of nodes.
+ * @return Map of node-id and count of threads.
+ */
+std::map<nid_t, unsigned int> Scheduler::count_threads() {
+  std::map<nid_t, unsigned int> loads;
+  for (auto& it_node : nodes) {
+    loads[it_node.first] = 0;
+  }
+  loads[my_info.nid] = 0;
+
+  for (auto& it_proc : processes) {
+    for (auto& it_thread : it_proc.second.threads) {
+      if (it_thread.second.nid != NID::NONE) {
+        loads[it_thread.second.nid]++;
+      }
+    }
+  }
+  return loads;
+}
+
+/**
+ * Evaluate warp of a thread by cost to give pages and benefit of less loaded node.
+ * Cost is time to move the working set reported by heartbeat_vm, and to fetch program of each
+ * frame after warp. Benefit is CPU time the thread gains in WarpCost::HORIZON, assuming
+ * threads in a node share CPU equally.
+ * @param pid Process-id of the thread.
+ * @param thread Information of the thread.
+ * @param dst_nid Warp destination node-id.
+ * @param src_load Count of threads in the node running the thread.
+ * @param dst_load Count of threads in warp destination node.
+ * @return Decision.
+ */
+Scheduler::WarpDecision Scheduler::evaluate_warp(const vpid_t& pid, const ThreadInfo& thread,
+                                                 const nid_t& dst_nid,
+                                                 unsigned int src_load, unsigned int dst_load) {
+  uint64_t cost = WarpCost::LATENCY +
+      (thread.ws_pages + thread.stack_depth) * WarpCost::PAGE_COST +
+      thread.ws_bytes * 1000 / WarpCost::BANDWIDTH;
+  double gain = 1.0 / (dst_load + 1) - 1.0 / (src_load == 0 ? 1 : src_load);
+  double benefit = gain * WarpCost::HORIZON;
+
+  WarpDecision decision;
+  if (gain <= 0) {
+    decision = WARP_REJECT;
+  } else if (benefit < cost) {
+    decision = WARP_DEFER;
+  } else {
+    decision = WARP_ACCEPT;
+  }
+
+  if (decision != WARP_ACCEPT && Trace::is_enabled()) {
+    picojson::object args = Trace::make_args(pid, thread.tid, thread.nid, dst_nid);
+    args.insert(std::make_pair("cost", picojson::value(static_cast<double>(cost))));
+    args.insert(std::make_pair("benefit", picojson::value(benefit)));
+    Trace::instant(decision == WARP_DEFER ? "warp_deferred" : "warp_rejected", thread.tid, args);
+  }
+  return decision;
+}
+
+/**
+ * Evaluate deferred warps again with working sets reported after deferring.
+ * Warp is dropped if the thread or destination is gone, or WarpCost::DEFER_LIMIT passed.
+ */
+void Scheduler::retry_deferred_warp() {
+  std::time_t now = std::time(nullptr);
+  std::map<nid_t, unsigned int> loads;
+
+  for (auto& it_proc : processes) {
+    for (auto& it_thread : it_proc.second.threads) {
+      ThreadInfo& thread = it_thread.second;
+      if (thread.deferred_nid == NID::NONE) continue;
+
+      if (thread.nid != my_info.nid || nodes.find(thread.deferred_nid) == nodes.end() ||
+          thread.deferred_since + WarpCost::DEFER_LIMIT < now) {
+        thread.deferred_nid = NID::NONE;
+        continue;
+      }
+
+      if (loads.empty()) loads = count_threads();
+      switch (evaluate_warp(it_proc.first, thread, thread.deferred_nid,
+                            loads[my_info.nid], loads[thread.deferred_nid])) {
+        case WARP_ACCEPT: {
+          send_command_require_warp_thread(it_proc.first, thread.tid, thread.deferred_nid);
+          loads[my_info.nid]--;
+          loads[thread.deferred_nid]++;
+          thread.deferred_nid = NID::NONE;
+        } break;
+
+        case WARP_DEFER:
+          break;
+
+        case WARP_REJECT: {
+          thread.deferred_nid = NID::NONE;
+        } break;
+      }
+    }
+  }
+}
+
 /**
  * When receive activate command, listup process and frontend that have to warp active node.
  * Ignode command if receive activate command from this node.
  * call warp method to do it.
+ * Threads of a process in this node are warped together if there are multiple threads.
  * @param packet Command packet.
  */
 void Scheduler::recv_command_activate(const CommandPacket& packet) {
@@ -239,11 +349,17 @@ void Scheduler::recv_command_activate(const CommandPacket& packet) {
   for (auto& it_info : processes) {
     ProcessInfo& info = it_info.second;
 
+    std::vector<vtid_t> tids;
     for (auto& it_thread : info.threads) {
       if (it_thread.second.nid == my_info.nid) {
-        send_command_require_warp_thread(info.pid, it_thread.first, packet.src_nid);
+        tids.push_back(it_thread.first);
       }
     }
+    if (tids.size() == 1) {
+      send_command_require_warp_thread(info.pid, tids.front(), packet.src_nid);
+    } else if (tids.size() > 1) {
+      send_command_require_warp_process(info.pid, packet.src_nid);
+    }
 
     if (info.gui_nid == my_info.nid) {
       send_command_require_warp_gui(info.pid, packet.src_nid);
@@ -295,25 +411,47 @@ void Scheduler::recv_command_distribute(const CommandPacket& packet) {
     assert(false);
   }
 
+  // Select the least loaded node.
+  std::map<nid_t, unsigned int> loads = count_threads();
   nid_t target_nid = NID::NONE;
   for (auto& it_node : nodes) {
-    if (it_node.second.nid != my_info.nid) {
+    if (it_node.second.nid != my_info.nid &&
+        (target_nid == NID::NONE || loads[it_node.first] < loads[target_nid])) {
       target_nid = it_node.second.nid;
-      break;
     }
   }
 
   // Skip if another node are not exist.
-  if (target_nid == my_info.nid) {
+  if (target_nid == NID::NONE) {
     return;
   }
 
+  std::time_t now = std::time(nullptr);
   for (auto& it_proc : processes) {
     ProcessInfo& proc = it_proc.second;
 
     for (auto& it_thread : proc.threads) {
-      if (it_thread.second.nid == my_info.nid) {
-        send_command_require_warp_thread(proc.pid, it_thread.first, target_nid);
+      ThreadInfo& thread = it_thread.second;
+      if (thread.nid != my_info.nid) continue;
+
+      switch (evaluate_warp(proc.pid, thread, target_nid, loads[my_info.nid],
+                            loads[target_nid])) {
+        case WARP_ACCEPT: {
+          send_command_require_warp_thread(proc.pid, it_thread.first, target_nid);
+          // Following threads are evaluated with loads after this warp.
+          loads[my_info.nid]--;
+          loads[target_nid]++;
+          thread.deferred_nid = NID::NONE;
+        } break;
+
+        case WARP_DEFER: {
+          thread.deferred_nid = target_nid;
+          thread.deferred_since = now;
+        } break;
+
+        case WARP_REJECT: {
+          thread.deferred_nid = NID::NONE;
+        } break;
       }
     }
   }
@@ -405,6 +543,11 @@ void Scheduler::recv_command_heartbeat_vm(const CommandPacket& packet) {
       thread_info.tid = tid;
       thread_info.nid = packet.src_nid;
       thread_info.heartbeat = now;
+      thread_info.ws_pages = 0;
+      thread_info.ws_bytes = 0;
+      thread_info.stack_depth = 0;
+      thread_info.deferred_nid = NID::NONE;
+      thread_info.deferred_since = 0;
       info.threads.insert(std::make_pair(tid, thread_info));
       is_changed = true;
 
@@ -412,6 +555,7 @@ void Scheduler::recv_command_heartbeat_vm(const CommandPacket& packet) {
       ThreadInfo& thread_info = info.threads.at(tid);
       thread_info.nid = packet.src_nid;
       thread_info.heartbeat = now;
+      thread_info.deferred_nid = NID::NONE;
       is_changed = true;
 
     } else {
@@ -421,6 +565,19 @@ void Scheduler::recv_command_heartbeat_vm(const CommandPacket& packet) {
     tids.insert(tid);
   }
 
+  // Update working sets used to evaluate warp.
+  auto it_working_sets = packet.content.find("working_sets");
+  if (it_working_sets != packet.content.end()) {
+    for (auto& it_ws : it_working_sets->second.get<picojson::object>()) {
+      auto thread_pair = info.threads.find(Convert::str2vtid(it_ws.first));
+      if (thread_pair == info.threads.end()) continue;
+      const picojson::object& working_set = it_ws.second.get<picojson::object>();
+      thread_pair->second.ws_pages = Convert::json2int<uint64_t>(working_set.at("pages"));
+      thread_pair->second.ws_bytes = Convert::json2int<uint64_t>(working_set.at("bytes"));
+      thread_pair->second.stack_depth = Convert::json2int<uint64_t>(working_set.at("depth"));
+    }
+  }
+
   // Remove thread-id from list if it had run in source node but not run at now.
   auto it_thread = info.threads.begin();
   while (it_thread != info.threads.end()) {
@@ -468,6 +625,53 @@ void Scheduler::recv_command_warp_gui(const CommandPacket& packet) {
   delegate->scheduler_create_gui(*this, packet.pid);
 }
 
+/**
+ * When recv warp_precopy command, create new vm if this node doesn't have it yet.
+ * Pass copy of pages to the vm.
+ * @param packet Command packet.
+ */
+void Scheduler::recv_command_warp_precopy(const CommandPacket& packet) {
+  prepare_warp_vm(packet);
+
+  if (Trace::is_enabled()) {
+    vtid_t tid = Convert::json2vtid(packet.content.at("tid"));
+    picojson::object args = Trace::make_args(packet.pid, tid, packet.src_nid, my_info.nid);
+    args.insert(std::make_pair("bytes", picojson::value(static_cast<double>
+                                                        (packet.content.at("bundle").
+                                                         serialize().size()))));
+    Trace::instant("recv_warp_precopy", tid, args);
+  }
+
+  picojson::object param;
+  param.insert(std::make_pair("src_nid", packet.content.at("src_nid")));
+  param.insert(std::make_pair("bundle", packet.content.at("bundle")));
+  send_command(packet.pid, NID::THIS, Module::VM, "warp_precopy", param);
+}
+
+/**
+ * When recv warp_process command, create new vm if this node doesn't have it yet.
+ * Send warp_process command to the vm to activate threads warped together.
+ * @param packet Command packet.
+ */
+void Scheduler::recv_command_warp_process(const CommandPacket& packet) {
+  prepare_warp_vm(packet);
+
+  if (Trace::is_enabled()) {
+    vtid_t root_tid = Convert::json2vtid(packet.content.at("root_tid"));
+    picojson::object args = Trace::make_args(packet.pid, root_tid, packet.src_nid, my_info.nid);
+    args.insert(std::make_pair("bytes", picojson::value(static_cast<double>
+                                                        (packet.content.at("bundle").
+                                                         serialize().size()))));
+    Trace::instant("recv_warp_process", root_tid, args);
+  }
+
+  picojson::object param;
+  param.insert(std::make_pair("src_nid", packet.content.at("src_nid")));
+  param.insert(std::make_pair("tids", packet.content.at("tids")));
+  param.insert(std::make_pair("bundle", packet.content.at("bundle")));
+  send_command(packet.pid, NID::THIS, Module::VM, "warp_process", param);
+}
+
 /**
  * When recv warp_thread command, create new.
  * Update process information this node having.
@@ -475,15 +679,41 @@ void Scheduler::recv_command_warp_gui(const CommandPacket& packet) {
  * @param packet Command packet.
  */
 void Scheduler::recv_command_warp_thread(const CommandPacket& packet) {
+  prepare_warp_vm(packet);
+
+  vtid_t tid = Convert::json2vtid(packet.content.at("tid"));
+  if (Trace::is_enabled()) {
+    picojson::object args = Trace::make_args(packet.pid, tid, packet.src_nid, my_info.nid);
+    auto it_bundle = packet.content.find("bundle");
+    if (it_bundle != packet.content.end()) {
+      args.insert(std::make_pair("bytes", picojson::value(static_cast<double>
+                                                          (it_bundle->second.serialize().
+                                                           size()))));
+    }
+    Trace::instant("recv_warp_thread", tid, args);
+  }
+  send_command_warp_thread(packet.pid, tid, packet.content);
+}
+
+/**
+ * Create new vm for warp destination if this node doesn't have it yet.
+ * Update process information this node having.
+ * @param packet Command packet containing information of the process.
+ */
+void Scheduler::prepare_warp_vm(const CommandPacket& packet) {
   std::time_t now = std::time(nullptr);
   auto it_info = processes.find(packet.pid);
   if (it_info == processes.end() ||
       !it_info->second.having_vm) {
+    // Memory image written by loader is read by the new vm if it is given.
+    auto it_image = packet.content.find("image");
     delegate->scheduler_create_vm(*this, packet.pid,
                                   Convert::json2vtid(packet.content.at("root_tid")),
                                   Convert::json2vaddr(packet.content.at("proc_addr")),
                                   Convert::json2nid(packet.content.at("master_nid")),
-                                  packet.content.at("name").get<std::string>());
+                                  packet.content.at("name").get<std::string>(),
+                                  it_image == packet.content.end() ? std::string() :
+                                  it_image->second.get<std::string>());
   }
 
   if (it_info == processes.end()) {
@@ -496,11 +726,9 @@ void Scheduler::recv_command_warp_thread(const CommandPacket& packet) {
     processes.insert(std::make_pair(packet.pid, info));
 
   } else {
+    it_info->second.having_vm = true;
     it_info->second.heartbeat = now;
   }
-
-  vtid_t tid = Convert::json2vtid(packet.content.at("tid"));
-  send_command_warp_thread(packet.pid, tid);
 }
 
 /**
@@ -571,6 +799,22 @@ void Scheduler::send_command_require_warp_gui(const vpid_t& pid, const nid_t& ta
   send_command(pid, NID::THIS, Module::GUI, "require_warp_gui", param);
 }
 
+/**
+ * Send require_warp_process command to VM module, to warp all threads in this node together.
+ * @param pid Target process-id to warp.
+ * @param target_nid Destination node-id to warp.
+ */
+void Scheduler::send_command_require_warp_process(const vpid_t& pid, const nid_t& target_nid) {
+  if (Trace::is_enabled()) {
+    picojson::object args = Trace::make_args(pid, 0, my_info.nid, target_nid);
+    Trace::instant("require_warp_process", 0, args);
+  }
+
+  picojson::object param;
+  param.insert(std::make_pair("target_nid", Convert::nid2json(target_nid)));
+  send_command(pid, NID::THIS, Module::VM, "require_warp_process", param);
+}
+
 /**
  * Send require_warp_thread command to VM module.
  * @param pid Target process-id to warp.
@@ -579,6 +823,11 @@ void Scheduler::send_command_require_warp_gui(const vpid_t& pid, const nid_t& ta
  */
 void Scheduler::send_command_require_warp_thread(const vpid_t& pid, vtid_t tid,
                                                  const nid_t& target_nid) {
+  if (Trace::is_enabled()) {
+    picojson::object args = Trace::make_args(pid, tid, my_info.nid, target_nid);
+    Trace::instant("require_warp", tid, args);
+  }
+
   picojson::object param;
   param.insert(std::make_pair("tid", Convert::vtid2json(tid)));
   param.insert(std::make_pair("target_nid", Convert::nid2json(target_nid)));
@@ -587,12 +836,20 @@ void Scheduler::send_command_require_warp_thread(const vpid_t& pid, vtid_t tid,
 
 /**
  * Send warp thread command to VM module.
+ * Pages given by source node are passed through.
  * @param pid Target process-id to warp.
  * @param tid Target thread-id to warp.
+ * @param warp Parameter of warp_thread command received from source node.
  */
-void Scheduler::send_command_warp_thread(const vpid_t& pid, vtid_t tid) {
+void Scheduler::send_command_warp_thread(const vpid_t& pid, vtid_t tid,
+                                         const picojson::object& warp) {
   picojson::object param;
   param.insert(std::make_pair("tid", Convert::vtid2json(tid)));
+  auto it_bundle = warp.find("bundle");
+  if (it_bundle != warp.end()) {
+    param.insert(std::make_pair("src_nid", warp.at("src_nid")));
+    param.insert(*it_bundle);
+  }
   send_command(pid, NID::THIS, Module::VM, "warp_thread", param);
 }
 }  // namespace processwarp
@@ -16,7 +16,7 @@ class SchedulerDelegate {
   virtual ~SchedulerDelegate();
   virtual void scheduler_create_vm(Scheduler& scheduler, const vpid_t& pid, vtid_t root_tid,
                                    vaddr_t proc_addr, const nid_t& master_nid,
-                                   const std::string& name) = 0;
+                                   const std::string& name, const std::string& image) = 0;
   virtual void scheduler_create_gui(Scheduler& scheduler, const vpid_t& pid) = 0;
   virtual void scheduler_send_command(Scheduler& scheduler, const CommandPacket& packet) = 0;
 };
@@ -43,8 +43,19 @@ class Scheduler {
   /** Random value generator. */
   std::mt19937_64 rnd;
 
+  /** Result of evaluating warp of a thread by cost. */
+  enum WarpDecision {
+    WARP_ACCEPT,  ///< Warp now.
+    WARP_DEFER,   ///< Evaluate again later, the thread may become lighter.
+    WARP_REJECT,  ///< Don't warp, destination isn't better than this node.
+  };
+
   void cleanup_unresponsive_node();
   void cleanup_unresponsive_process();
+  std::map<nid_t, unsigned int> count_threads();
+  WarpDecision evaluate_warp(const vpid_t& pid, const ThreadInfo& thread, const nid_t& dst_nid,
+                             unsigned int src_load, unsigned int dst_load);
+  void retry_deferred_warp();
 
   void recv_command_activate(const CommandPacket& packet);
   void recv_command_create_gui(const CommandPacket& packet);
@@ -54,14 +65,18 @@ class Scheduler {
   void recv_command_heartbeat_vm(const CommandPacket& packet);
   void recv_command_require_processes_info(const CommandPacket& packet);
   void recv_command_warp_gui(const CommandPacket& packet);
+  void recv_command_warp_precopy(const CommandPacket& packet);
+  void recv_command_warp_process(const CommandPacket& packet);
   void recv_command_warp_thread(const CommandPacket& packet);
+  void prepare_warp_vm(const CommandPacket& packet);
 
   void send_command(const vpid_t& pid, const nid_t& dst_nid, Module::Type module,
                     const std::string& command, picojson::object& param);
   void send_command_heartbeat_scheduler();
   void send_command_processes_info();
   void send_command_require_warp_gui(const vpid_t& pid, const nid_t& target_nid);
+  void send_command_require_warp_process(const vpid_t& pid, const nid_t& target_nid);
   void send_command_require_warp_thread(const vpid_t& pid, vtid_t tid, const nid_t& target_nid);
-  void send_command_warp_thread(const vpid_t& pid, vtid_t tid);
+  void send_command_warp_thread(const vpid_t& pid, vtid_t tid, const picojson::object& warp);
 };
 }  // namespace processwarp
@@ -2,8 +2,8 @@
 #include <memory>
 #include <string>
 
-#include "convert.hpp"
 #include "func_store.hpp"
+#include "record.hpp"
 #include "stackinfo.hpp"
 
 namespace processwarp {
@@ -20,7 +20,17 @@ StackInfo::StackInfo(vaddr_t addr_,
     ret_addr(ret_addr_),
     normal_pc(normal_pc_),
     unwind_pc(unwind_pc_),
-    stack(stack_) {
+    stack(stack_),
+    var_arg(VADDR_NULL),
+    pc(0),
+    phi0(0),
+    phi1(0),
+    type(VADDR_NULL),
+    type_operator(nullptr),
+    alignment(0),
+    output(VADDR_NULL),
+    value(VADDR_NULL),
+    address(VADDR_NULL) {
 }
 
 // Allocate a now stack-information on memory.
@@ -28,108 +38,88 @@ vaddr_t StackInfo::alloc(VMemory::Accessor& memory,
                          vaddr_t func, vaddr_t ret_addr,
                          unsigned int normal_pc, unsigned int unwind_pc,
                          vaddr_t stack) {
-  picojson::object js_stackinfo;
-
-  js_stackinfo.insert(std::make_pair("func", Convert::vaddr2json(func)));
-  js_stackinfo.insert(std::make_pair("ret_addr", Convert::vaddr2json(ret_addr)));
-  js_stackinfo.insert(std::make_pair("normal_pc",
-                                     Convert::int2json<unsigned int>(normal_pc)));
-  js_stackinfo.insert(std::make_pair("unwind_pc",
-                                     Convert::int2json<unsigned int>(unwind_pc)));
-  js_stackinfo.insert(std::make_pair("stack", Convert::vaddr2json(stack)));
-
-  js_stackinfo.insert(std::make_pair("alloca_addrs", picojson::value(picojson::array())));
-  js_stackinfo.insert(std::make_pair("var_arg", Convert::vaddr2json(VADDR_NULL)));
-  js_stackinfo.insert(std::make_pair("pc", Convert::int2json<unsigned int>(0)));
-  js_stackinfo.insert(std::make_pair("phi0", Convert::int2json<unsigned int>(0)));
-  js_stackinfo.insert(std::make_pair("phi1", Convert::int2json<unsigned int>(0)));
-  js_stackinfo.insert(std::make_pair("type", Convert::vaddr2json(VADDR_NULL)));
-  js_stackinfo.insert(std::make_pair("alignment", Convert::int2json<vm_int_t>(0)));
-  js_stackinfo.insert(std::make_pair("output", Convert::vaddr2json(VADDR_NULL)));
-  js_stackinfo.insert(std::make_pair("value", Convert::vaddr2json(VADDR_NULL)));
-  js_stackinfo.insert(std::make_pair("address", Convert::vaddr2json(VADDR_NULL)));
-
-  std::string str_stackinfo = picojson::value(js_stackinfo).serialize();
-  return memory.set_meta_area(str_stackinfo, VADDR_NULL);
+  StackInfo stackinfo(VADDR_NULL, func, ret_addr, normal_pc, unwind_pc, stack);
+  return memory.set_meta_area(stackinfo.encode(), VADDR_NULL);
 }
 
 // Read out stack-informaition from memory and generate instance.
 std::unique_ptr<StackInfo> StackInfo::read(VMemory::Accessor& memory, vaddr_t addr) {
-  picojson::value js_tmp;
-  std::istringstream is(memory.get_meta_area(addr));
-  std::string err = picojson::parse(js_tmp, is);
-  if (!err.empty()) {
-    /// @todo error
-    assert(false);
-  }
-  picojson::object& js_stackinfo = js_tmp.get<picojson::object>();
+  std::string data = memory.get_meta_area(addr);
+  RecordReader reader(data);
+  vaddr_t func = reader.get<vaddr_t>();
+  vaddr_t ret_addr = reader.get<vaddr_t>();
+  unsigned int normal_pc = reader.get<uint32_t>();
+  unsigned int unwind_pc = reader.get<uint32_t>();
+  vaddr_t stack = reader.get<vaddr_t>();
   std::unique_ptr<StackInfo> stackinfo
-      (new StackInfo(addr,
-                     Convert::json2vaddr(js_stackinfo.at("func")),
-                     Convert::json2vaddr(js_stackinfo.at("ret_addr")),
-                     Convert::json2int<unsigned int>(js_stackinfo.at("normal_pc")),
-                     Convert::json2int<unsigned int>(js_stackinfo.at("unwind_pc")),
-                     Convert::json2vaddr(js_stackinfo.at("stack"))));
+      (new StackInfo(addr, func, ret_addr, normal_pc, unwind_pc, stack));
 
-  stackinfo->read(js_stackinfo);
+  stackinfo->read(reader);
+  stackinfo->record.swap(data);
 
   return stackinfo;
 }
 
 // Read and update stack-information for this instance.
 void StackInfo::read(VMemory::Accessor& memory) {
-  picojson::value js_tmp;
-  std::istringstream is(memory.get_meta_area(addr));
-  std::string err = picojson::parse(js_tmp, is);
-  if (!err.empty()) {
-    /// @todo error
-    assert(false);
-  }
+  std::string data = memory.get_meta_area(addr);
+  if (data == record) return;
 
-  return read(js_tmp.get<picojson::object>());
+  RecordReader reader(data);
+  reader.skip(sizeof(vaddr_t) * 3 + sizeof(uint32_t) * 2);
+  read(reader);
+  record.swap(data);
 }
 
 // Read and update stack-information for this instance.
-void StackInfo::read(const picojson::object& js_stackinfo) {
-  alloca_addrs = Convert::json2vaddr_vector(js_stackinfo.at("alloca_addrs"));
-  var_arg = Convert::json2vaddr(js_stackinfo.at("var_arg"));
-  pc = Convert::json2int<unsigned int>(js_stackinfo.at("pc"));
-  phi0 = Convert::json2int<unsigned int>(js_stackinfo.at("phi0"));
-  phi1 = Convert::json2int<unsigned int>(js_stackinfo.at("phi1"));
-  type = Convert::json2vaddr(js_stackinfo.at("type"));
+void StackInfo::read(RecordReader& reader) {
+  var_arg = reader.get<vaddr_t>();
+  pc = reader.get<uint32_t>();
+  phi0 = reader.get<uint32_t>();
+  phi1 = reader.get<uint32_t>();
+  type = reader.get<vaddr_t>();
   type_operator = nullptr;
   type_store.reset(nullptr);
-  alignment = Convert::json2int<vm_int_t>(js_stackinfo.at("alignment"));
-  output = Convert::json2vaddr(js_stackinfo.at("output"));
-  value = Convert::json2vaddr(js_stackinfo.at("value"));
-  address = Convert::json2vaddr(js_stackinfo.at("address"));
+  alignment = reader.get<vm_int_t>();
+  output = reader.get<vaddr_t>();
+  value = reader.get<vaddr_t>();
+  address = reader.get<vaddr_t>();
+  alloca_addrs = reader.get_vector();
 }
 
 // Write out stack-information to memory.
 void StackInfo::write(VMemory::Accessor& memory) {
-  picojson::object js_stackinfo;
-
-  js_stackinfo.insert(std::make_pair("func", Convert::vaddr2json(func)));
-  js_stackinfo.insert(std::make_pair("ret_addr", Convert::vaddr2json(ret_addr)));
-  js_stackinfo.insert(std::make_pair("normal_pc",
-                                     Convert::int2json<unsigned int>(normal_pc)));
-  js_stackinfo.insert(std::make_pair("unwind_pc",
-                                     Convert::int2json<unsigned int>(unwind_pc)));
-  js_stackinfo.insert(std::make_pair("stack", Convert::vaddr2json(stack)));
-
-  js_stackinfo.insert(std::make_pair("alloca_addrs",
-                                     Convert::vaddr_vector2json(alloca_addrs)));
-  js_stackinfo.insert(std::make_pair("var_arg", Convert::vaddr2json(var_arg)));
-  js_stackinfo.insert(std::make_pair("pc", Convert::int2json<unsigned int>(pc)));
-  js_stackinfo.insert(std::make_pair("phi0", Convert::int2json<unsigned int>(phi0)));
-  js_stackinfo.insert(std::make_pair("phi1", Convert::int2json<unsigned int>(phi1)));
-  js_stackinfo.insert(std::make_pair("type", Convert::vaddr2json(type)));
-  js_stackinfo.insert(std::make_pair("alignment", Convert::int2json<vm_int_t>(alignment)));
-  js_stackinfo.insert(std::make_pair("output", Convert::vaddr2json(output)));
-  js_stackinfo.insert(std::make_pair("value", Convert::vaddr2json(value)));
-  js_stackinfo.insert(std::make_pair("address", Convert::vaddr2json(address)));
-
-  memory.update_meta_area(addr, picojson::value(js_stackinfo).serialize());
+  std::string data = encode();
+
+  if (data.size() != record.size()) {
+    memory.update_meta_area(addr, data);
+
+  } else {
+    // Registers are at fixed position, so write back only the range changed.
+    size_t begin = 0;
+    size_t end = data.size();
+    while (begin != end && data[begin] == record[begin]) begin++;
+    if (begin == end) return;
+    while (data[end - 1] == record[end - 1]) end--;
+    memory.update_meta_area(addr, begin, reinterpret_cast<const uint8_t*>(data.data()) + begin,
+                            end - begin);
+  }
+  record.swap(data);
+}
+
+// Make binary record of stack-information.
+std::string StackInfo::encode() const {
+  RecordWriter writer;
+  writer.put<vaddr_t>(func).put<vaddr_t>(ret_addr);
+  writer.put<uint32_t>(normal_pc).put<uint32_t>(unwind_pc);
+  writer.put<vaddr_t>(stack);
+  writer.put<vaddr_t>(var_arg);
+  writer.put<uint32_t>(pc).put<uint32_t>(phi0).put<uint32_t>(phi1);
+  writer.put<vaddr_t>(type);
+  writer.put<vm_int_t>(alignment);
+  writer.put<vaddr_t>(output).put<vaddr_t>(value).put<vaddr_t>(address);
+  writer.put_vector(alloca_addrs);
+  return std::move(writer.get());
 }
 
 // Free all memory area bind to this stack without a area bind to this instance.
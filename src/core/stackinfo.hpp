@@ -1,9 +1,11 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "func_store.hpp"
+#include "record.hpp"
 #include "type.hpp"
 #include "type_store.hpp"
 #include "wrapped_operator.hpp"
@@ -95,6 +97,7 @@ class StackInfo {
 
   /**
    * Write out stack-information to memory.
+   * Only the range changed since last read or write is written if the size isn't changed.
    * @param memory
    */
   void write(VMemory::Accessor& memory);
@@ -106,6 +109,9 @@ class StackInfo {
   void destroy(VMemory::Accessor& memory);
 
  private:
+  /** Binary record read or written at last. */
+  std::string record;
+
   /**
    * コンストラクタ。
    * @param addr
@@ -124,8 +130,15 @@ class StackInfo {
 
   /**
    * Read and update stack-information for this instance.
-   * @param js_stackinfo
+   * @param reader Reader of record after the constant part.
+   */
+  void read(RecordReader& reader);
+
+  /**
+   * Make binary record of stack-information.
+   * Constant part and registers are at fixed position, alloca list follows them.
+   * @return Record.
    */
-  void read(const picojson::object& js_object);
+  std::string encode() const;
 };
 }  // namespace processwarp
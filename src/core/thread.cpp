@@ -2,11 +2,13 @@
 #include <cassert>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "constant.hpp"
 #include "convert.hpp"
 #include "core_mid.hpp"
 #include "logger.hpp"
+#include "record.hpp"
 #include "thread.hpp"
 
 namespace processwarp {
@@ -73,27 +75,15 @@ Thread::Thread(vtid_t tid_, std::unique_ptr<VMemory::Accessor> memory_) :
       new WrappedPrimitiveOperator<double>(*memory),  // 33 double
       nullptr,  // 34
       nullptr,  // 35 quad
-      } {
+      },
+    record_version(0) {
 }
 
 // Allocate thread on memory.
 std::pair<vtid_t, std::unique_ptr<Thread>>
             Thread::alloc(std::unique_ptr<VMemory::Accessor> memory, vtid_t tid) {
-  picojson::object js_thread;
-
-  js_thread.insert(std::make_pair("tid", Convert::vtid2json(tid)));
-  js_thread.insert(std::make_pair("status", Convert::int2json<uint8_t>(NORMAL)));
-  js_thread.insert(std::make_pair("join_waiting", Convert::vtid2json(JoinWaitStatus::NONE)));
-  js_thread.insert(std::make_pair("stack", picojson::value(picojson::array())));
-  js_thread.insert(std::make_pair("funcs_at_befor_warp",
-                                  picojson::value(picojson::array())));
-  js_thread.insert(std::make_pair("funcs_at_after_warp",
-                                  picojson::value(picojson::array())));
-  js_thread.insert(std::make_pair("warp_parameter",
-                                  picojson::value(picojson::object())));
-
-  std::string str_thread = picojson::value(js_thread).serialize();
-  tid = memory->set_meta_area(str_thread, tid);
+  tid = memory->set_meta_area(encode(NORMAL, JoinWaitStatus::NONE, std::vector<vaddr_t>(),
+                                     FuncsAtWarp(), FuncsAtWarp(), WarpParameter()), tid);
 
   return std::make_pair(tid, Thread::read(tid, std::move(memory)));
 }
@@ -109,46 +99,50 @@ std::unique_ptr<Thread> Thread::read(vtid_t tid,
 
 // Read out and update thread information on instance.
 void Thread::read() {
-  picojson::value js_tmp;
-  std::istringstream is(memory->get_meta_area(tid));
-  std::string err = picojson::parse(js_tmp, is);
-  if (!err.empty()) {
-    /// @todo error
-    assert(false);
+  // Skip comparing whole of record while nobody changes the page.
+  uint64_t version = memory->get_meta_version(tid);
+  if (version == record_version) return;
+  std::string data = memory->get_meta_area(tid);
+  // Version is changed by writing of this thread too.
+  if (data == record) {
+    record_version = version;
+    return;
   }
-  picojson::object& js_thread = js_tmp.get<picojson::object>();
-
-  status = static_cast<Status>(Convert::json2int<uint8_t>(js_thread.at("status")));
-  join_waiting = Convert::json2vtid(js_thread.at("join_waiting"));
-  stack = Convert::json2vaddr_vector(js_thread.at("stack"));
-  funcs_at_befor_warp = Convert::json2vaddr_vector(js_thread.at("funcs_at_befor_warp"));
-  funcs_at_after_warp = Convert::json2vaddr_vector(js_thread.at("funcs_at_after_warp"));
-  warp_parameter.clear();
-  for (auto& it : js_thread.at("warp_parameter").get<picojson::object>()) {
-    warp_parameter.insert(std::make_pair(Convert::str2int<vm_int_t>(it.first),
-                                         Convert::json2int<vm_int_t>(it.second)));
+
+  // Decode into locals to keep instance and version as before if the record is broken.
+  RecordReader reader(data);
+  Status new_status = static_cast<Status>(reader.get<uint8_t>());
+  vtid_t new_join_waiting = reader.get<vtid_t>();
+  std::vector<vaddr_t> new_stack = reader.get_vector();
+  FuncsAtWarp new_funcs_at_befor_warp = reader.get_vector();
+  FuncsAtWarp new_funcs_at_after_warp = reader.get_vector();
+  WarpParameter new_warp_parameter;
+  for (uint32_t count = reader.get<uint32_t>(); count != 0; count--) {
+    vm_int_t key = reader.get<vm_int_t>();
+    new_warp_parameter.insert(std::make_pair(key, reader.get<vm_int_t>()));
+  }
+
+  status = new_status;
+  join_waiting = new_join_waiting;
+  stack.swap(new_stack);
+  funcs_at_befor_warp.swap(new_funcs_at_befor_warp);
+  funcs_at_after_warp.swap(new_funcs_at_after_warp);
+  warp_parameter.swap(new_warp_parameter);
+  record.swap(data);
+  record_version = version;
+
+  // Require stack frames not read yet at once, warped thread reads them soon.
+  std::vector<vaddr_t> frames;
+  for (auto addr : stack) {
+    if (stackinfos.find(addr) == stackinfos.end()) {
+      frames.push_back(addr);
+    }
   }
+  memory->prefetch(frames);
 }
 
 // Write out thread information to memory.
 void Thread::write() {
-  picojson::object js_thread;
-
-  js_thread.insert(std::make_pair("tid", Convert::vtid2json(tid)));
-  js_thread.insert(std::make_pair("status", Convert::int2json<uint8_t>(status)));
-  js_thread.insert(std::make_pair("join_waiting", Convert::vtid2json(join_waiting)));
-  js_thread.insert(std::make_pair("stack", Convert::vaddr_vector2json(stack)));
-  js_thread.insert(std::make_pair("funcs_at_befor_warp",
-                                  Convert::vaddr_vector2json(funcs_at_befor_warp)));
-  js_thread.insert(std::make_pair("funcs_at_after_warp",
-                                  Convert::vaddr_vector2json(funcs_at_after_warp)));
-  picojson::object js_warp_parameter;
-  for (auto &it : warp_parameter) {
-    js_warp_parameter.insert(std::make_pair(Convert::int2str<vm_int_t>(it.first),
-                                            Convert::int2json<vm_int_t>(it.second)));
-  }
-  js_thread.insert(std::make_pair("warp_parameter", picojson::value(js_warp_parameter)));
-
   for (auto& it : stack) {
     auto it_stackinfo = stackinfos.find(it);
     if (it_stackinfo != stackinfos.end()) {
@@ -156,7 +150,26 @@ void Thread::write() {
     }
   }
 
-  memory->update_meta_area(tid, picojson::value(js_thread).serialize());
+  std::string data = encode(status, join_waiting, stack, funcs_at_befor_warp,
+                            funcs_at_after_warp, warp_parameter);
+  if (data == record) return;
+  memory->update_meta_area(tid, data);
+  record.swap(data);
+}
+
+// Make binary record of thread information.
+std::string Thread::encode(Status status, vtid_t join_waiting, const std::vector<vaddr_t>& stack,
+                           const FuncsAtWarp& funcs_at_befor_warp,
+                           const FuncsAtWarp& funcs_at_after_warp,
+                           const WarpParameter& warp_parameter) {
+  RecordWriter writer;
+  writer.put<uint8_t>(status).put<vtid_t>(join_waiting);
+  writer.put_vector(stack).put_vector(funcs_at_befor_warp).put_vector(funcs_at_after_warp);
+  writer.put<uint32_t>(static_cast<uint32_t>(warp_parameter.size()));
+  for (auto& it : warp_parameter) {
+    writer.put<vm_int_t>(it.first).put<vm_int_t>(it.second);
+  }
+  return std::move(writer.get());
 }
 
 // 型依存の演算インスタンスを取得する。
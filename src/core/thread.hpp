@@ -2,10 +2,11 @@
 
 #include <picojson.h>
 
-#include <vector>
 #include <map>
 #include <memory>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include "stackinfo.hpp"
 #include "type.hpp"
@@ -86,11 +87,13 @@ class Thread {
 
   /**
    * Read out and update thread information on instance.
+   * Record is not decoded if it isn't changed since last read or write.
    */
   void read();
 
   /**
    * Write out thread information to memory.
+   * Record is not written if it isn't changed since last read or write.
    */
   void write();
 
@@ -135,6 +138,21 @@ class Thread {
   bool require_warp(const nid_t& target_nid);
 
  private:
+  /** Binary record read or written at last, empty if there is no record yet. */
+  std::string record;
+  /** Version of meta page the record was read from, 0 if it is not read yet. */
+  uint64_t record_version;
+
+  /**
+   * Make binary record of thread information.
+   * Status and join_waiting are at fixed position, lists follow them.
+   * @return Record.
+   */
+  static std::string encode(Status status, vtid_t join_waiting, const std::vector<vaddr_t>& stack,
+                            const FuncsAtWarp& funcs_at_befor_warp,
+                            const FuncsAtWarp& funcs_at_after_warp,
+                            const WarpParameter& warp_parameter);
+
   /**
    * Constructor with thread-id.
    * @param addr Address of thread data.
@@ -0,0 +1,170 @@
+
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+
+#include "convert.hpp"
+#include "trace.hpp"
+
+namespace processwarp {
+namespace Trace {
+/** Stream to write events, not opened while trace is disabled. */
+static std::ofstream stream;
+/** Process-id of this process, used as pid of events. */
+static int os_pid = 0;
+
+/**
+ * Write an event to the trace file.
+ * File is written as JSON array without terminator that Chrome accepts, so events written
+ * before this process is killed can be read.
+ * @param event Event to write.
+ */
+static void write(picojson::object& event) {
+  event.insert(std::make_pair("pid", picojson::value(static_cast<double>(os_pid))));
+  stream << picojson::value(event).serialize() << ",\n";
+  stream.flush();
+}
+
+/**
+ * Make an event having common fields.
+ * Thread-id is cut to 32bit to use as tid of events, full thread-id is written in args.
+ * @param name Name of event.
+ * @param ph Phase of event.
+ * @param tid Thread-id of virtual machine, or 0 if the event isn't for a thread.
+ * @param ts Time of event (usec).
+ * @param args Arguments of event.
+ * @return Event.
+ */
+static picojson::object make_event(const std::string& name, const char* ph, vtid_t tid,
+                                   uint64_t ts, picojson::object& args) {
+  picojson::object event;
+  event.insert(std::make_pair("name", picojson::value(name)));
+  event.insert(std::make_pair("cat", picojson::value(std::string("warp"))));
+  event.insert(std::make_pair("ph", picojson::value(std::string(ph))));
+  event.insert(std::make_pair("ts", picojson::value(static_cast<double>(ts))));
+  event.insert(std::make_pair("tid", picojson::value(static_cast<double>
+                                                     (static_cast<uint32_t>(tid)))));
+  event.insert(std::make_pair("args", picojson::value(args)));
+  return event;
+}
+
+/**
+ * Open a trace file and start to write events.
+ * File name is made by name and process-id of this process.
+ * @param dir Directory to write the trace file.
+ * @param name Name of this process shown in trace.
+ */
+void initialize(const std::string& dir, const std::string& name) {
+  os_pid = getpid();
+  stream.open(dir + "/" + name + "." + std::to_string(os_pid) + ".json",
+              std::ios::out | std::ios::trunc);
+  if (!stream) return;
+  stream << "[\n";
+
+  picojson::object args;
+  args.insert(std::make_pair("name", picojson::value(name)));
+  picojson::object event;
+  event.insert(std::make_pair("name", picojson::value(std::string("process_name"))));
+  event.insert(std::make_pair("ph", picojson::value(std::string("M"))));
+  event.insert(std::make_pair("args", picojson::value(args)));
+  write(event);
+}
+
+/**
+ * Check trace is enabled.
+ * Use this to skip making arguments that is costly.
+ * @return True if events are written.
+ */
+bool is_enabled() {
+  return stream.is_open() && stream.good();
+}
+
+/**
+ * Get time for trace.
+ * Wall clock is used so that events of nodes can be merged.
+ * @return Time (usec).
+ */
+uint64_t get_time_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>
+    (std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Make arguments of event for warp of a thread.
+ * @param pid Process-id.
+ * @param tid Thread-id.
+ * @param src Node-id warp from.
+ * @param dst Node-id warp to.
+ * @return Arguments.
+ */
+picojson::object make_args(const vpid_t& pid, vtid_t tid, const nid_t& src, const nid_t& dst) {
+  picojson::object args;
+  args.insert(std::make_pair("pid", Convert::vpid2json(pid)));
+  args.insert(std::make_pair("tid", Convert::vtid2json(tid)));
+  args.insert(std::make_pair("src", Convert::nid2json(src)));
+  args.insert(std::make_pair("dst", Convert::nid2json(dst)));
+  return args;
+}
+
+/**
+ * Write a span finished just now.
+ * @param name Name of span.
+ * @param tid Thread-id.
+ * @param start Time the span started, got by get_time_us.
+ * @param args Arguments of span.
+ */
+void complete(const std::string& name, vtid_t tid, uint64_t start, picojson::object& args) {
+  if (!is_enabled()) return;
+  uint64_t now = get_time_us();
+  picojson::object event = make_event(name, "X", tid, start, args);
+  event.insert(std::make_pair("dur", picojson::value(static_cast<double>(now - start))));
+  write(event);
+}
+
+/**
+ * Write an event at this time.
+ * @param name Name of event.
+ * @param tid Thread-id.
+ * @param args Arguments of event.
+ */
+void instant(const std::string& name, vtid_t tid, picojson::object& args) {
+  if (!is_enabled()) return;
+  picojson::object event = make_event(name, "i", tid, get_time_us(), args);
+  event.insert(std::make_pair("s", picojson::value(std::string("t"))));
+  write(event);
+}
+
+/**
+ * Write begin of a span that can end in another process or node.
+ * Spans are bound by thread-id, so a span begun by warp source is ended by warp destination.
+ * @param name Name of span.
+ * @param tid Thread-id.
+ * @param args Arguments of span.
+ */
+void async_begin(const std::string& name, vtid_t tid, picojson::object& args) {
+  if (!is_enabled()) return;
+  picojson::object id2;
+  id2.insert(std::make_pair("global", Convert::vtid2json(tid)));
+  picojson::object event = make_event(name, "b", tid, get_time_us(), args);
+  event.insert(std::make_pair("id2", picojson::value(id2)));
+  write(event);
+}
+
+/**
+ * Write end of a span begun by async_begin.
+ * @param name Name of span.
+ * @param tid Thread-id.
+ * @param args Arguments of span.
+ */
+void async_end(const std::string& name, vtid_t tid, picojson::object& args) {
+  if (!is_enabled()) return;
+  picojson::object id2;
+  id2.insert(std::make_pair("global", Convert::vtid2json(tid)));
+  picojson::object event = make_event(name, "e", tid, get_time_us(), args);
+  event.insert(std::make_pair("id2", picojson::value(id2)));
+  write(event);
+}
+}  // namespace Trace
+}  // namespace processwarp
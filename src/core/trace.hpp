@@ -0,0 +1,26 @@
+#pragma once
+
+#include <picojson.h>
+
+#include <string>
+
+#include "type.hpp"
+
+namespace processwarp {
+/**
+ * Trace of phases for warp, written as Chrome trace event format.
+ * Each process writes events to own file in a directory, files of nodes can be merged by
+ * script/merge_trace.py and opened by chrome://tracing or Perfetto.
+ * Nothing is written until initialize is called.
+ */
+namespace Trace {
+void initialize(const std::string& dir, const std::string& name);
+bool is_enabled();
+uint64_t get_time_us();
+picojson::object make_args(const vpid_t& pid, vtid_t tid, const nid_t& src, const nid_t& dst);
+void complete(const std::string& name, vtid_t tid, uint64_t start, picojson::object& args);
+void instant(const std::string& name, vtid_t tid, picojson::object& args);
+void async_begin(const std::string& name, vtid_t tid, picojson::object& args);
+void async_end(const std::string& name, vtid_t tid, picojson::object& args);
+}  // namespace Trace
+}  // namespace processwarp
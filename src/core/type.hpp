@@ -95,6 +95,16 @@ struct ThreadInfo {
   vtid_t tid;
   nid_t nid;
   std::time_t heartbeat;
+  /** Count of pages the thread would give with warp, reported by heartbeat_vm. */
+  uint64_t ws_pages;
+  /** Bytes of pages the thread would give with warp, reported by heartbeat_vm. */
+  uint64_t ws_bytes;
+  /** Depth of call stack, reported by heartbeat_vm. */
+  uint64_t stack_depth;
+  /** Destination node-id of warp deferred by cost, or NONE. */
+  nid_t deferred_nid;
+  /** Time the warp was deferred first. */
+  std::time_t deferred_since;
 };
 
 /**
@@ -11,6 +11,7 @@
 #endif
 #include <sys/param.h>
 
+#include <chrono>
 #include <iomanip>
 #include <memory>
 #include <sstream>
@@ -71,6 +72,7 @@ static const char* OPCODE_STR[] = {
   "SELECT",
   "SHUFFLE",
   "VA_ARG",
+  "ATOMIC",
 };
 
 #if defined(ENABLE_LLVM) && !defined(NDEBUG) && !defined(EMSCRIPTEN)
@@ -102,6 +104,33 @@ std::string Util::calc_sha256(const std::string& src) {
 }
 #endif
 
+/**
+ * Calculate 64bit FNV-1a hash from a data.
+ * Result is same on every platform, so it is usable to share a value between nodes.
+ * @param src Target data.
+ * @return Hash value.
+ */
+uint64_t Util::calc_fnv1a(const std::string& src) {
+  uint64_t hash = 0xCBF29CE484222325;
+
+  for (auto c : src) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x00000100000001B3;
+  }
+
+  return hash;
+}
+
+/**
+ * Get time of monotonic clock.
+ * The origin is not defined, so it is usable only to measure interval in this process.
+ * @return Time (msec).
+ */
+uint64_t Util::get_clock_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>
+    (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 /**
  * Get the last component of a pathname.
  * If suffix is matched to last of the pathname, remove it from return value.
@@ -35,6 +35,8 @@
 namespace processwarp {
 namespace Util {
 std::string calc_sha256(const std::string& src);
+uint64_t calc_fnv1a(const std::string& src);
+uint64_t get_clock_ms();
 std::string file_basename(const std::string& path, bool cutoff_ext = false);
 std::string file_dirname(const std::string& path);
 std::string get_my_fullpath();
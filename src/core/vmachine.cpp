@@ -1,5 +1,6 @@
 
 #include <ctime>
+#include <fstream>
 #include <map>
 #include <random>
 #include <set>
@@ -22,7 +23,9 @@
 #include "error.hpp"
 #include "finally.hpp"
 #include "logger.hpp"
+#include "trace.hpp"
 #include "type.hpp"
+#include "util.hpp"
 #include "vmachine.hpp"
 #include "vmemory.hpp"
 
@@ -52,7 +55,8 @@ VMachine::VMachine(VMachineDelegate& delegate_,
     delegate(delegate_),
     libs(libs_),
     lib_filter(lib_filter_),
-    last_heartbeat(0) {
+    last_heartbeat(0),
+    last_stats(0) {
 }
 
 /**
@@ -70,6 +74,7 @@ void VMachine::initialize(const vpid_t& pid, const vtid_t& root_tid, vaddr_t pro
                            proc_addr, master_nid);
   process->setup();
   process->name = name;
+  vmemory.set_prefetch(Convert::vpid2str(pid), true);
   initialize_builtin();
 }
 
@@ -86,7 +91,7 @@ void VMachine::initialize_gui(BuiltinGuiDelegate& delegate) {
  * Main loop.
  */
 void VMachine::execute() {
-  std::time_t now = std::time(nullptr);
+  uint64_t now = Util::get_clock_ms();
   vtid_t tid;
   Thread* thread;
   Finally finally;
@@ -97,12 +102,40 @@ void VMachine::execute() {
 
       /// @todo migrate method anywhere
       for (auto& it_waiting : process->waiting_warp_result) {
-        if (it_waiting.second + MEMORY_REQUIRE_INTERVAL < now) {
+        // Threads warped together are resent by update_warp_batch.
+        if (process->warp_batch.tids.find(it_waiting.first) != process->warp_batch.tids.end()) {
+          continue;
+        }
+        if (it_waiting.second + WARP_RESEND_INTERVAL < now) {
+          if (Trace::is_enabled()) {
+            picojson::object args = Trace::make_args(process->pid, it_waiting.first, my_nid,
+                                                     process->get_thread(it_waiting.first).
+                                                     warp_dst);
+            Trace::instant("warp_resend", it_waiting.first, args);
+          }
           send_command_warp_thread(process->get_thread(it_waiting.first));
           it_waiting.second = now;
         }
       }
 
+      // Send pages of threads before warp, per interval.
+      auto it_precopy = process->precopies.begin();
+      while (it_precopy != process->precopies.end()) {
+        if (process->active_threads.find(it_precopy->first) == process->active_threads.end()) {
+          it_precopy = process->precopies.erase(it_precopy);
+          continue;
+        }
+        if (!it_precopy->second.is_required &&
+            it_precopy->second.time + VMemoryWarp::PRECOPY_INTERVAL < now) {
+          precopy_thread(process->get_thread(it_precopy->first), it_precopy->second, now);
+        }
+        it_precopy++;
+      }
+
+      update_warp_batch(now);
+      progress_checkpoint(now);
+      vmemory.resend_commands(now);
+
       // Reload thread information from memory.
       auto it_thread = process->threads.begin();
       while (it_thread != process->threads.end()) {
@@ -113,6 +146,7 @@ void VMachine::execute() {
           it_thread++;
 
         } else {
+          process->stalls.erase(it_thread->first);
           it_thread = process->threads.erase(it_thread);
         }
       }
@@ -141,6 +175,11 @@ void VMachine::execute() {
       thread = &process->get_thread(tid);
     }
 
+    // Stop running threads at this point while checkpoint waits, warping threads are left.
+    if (!checkpoint_request.path.empty() && thread->status == Thread::NORMAL) {
+      return;
+    }
+
     VMemory::Accessor::MasterKey thread_master_key = thread->memory->keep_master(tid);
     finally.add([&]{
         thread->write();
@@ -161,19 +200,41 @@ void VMachine::execute() {
         thread->status == Thread::BEFOR_WARP ||
         thread->status == Thread::AFTER_WARP) {
       // run thread
+      bool is_after_warp = thread->status == Thread::AFTER_WARP;
       process->execute(*thread, 100);
       Logger::dbg_vm(CoreMid::L1001, "loop finish status=%d", thread->status);
 
+      if (is_after_warp && thread->status != Thread::AFTER_WARP && Trace::is_enabled()) {
+        picojson::object args = Trace::make_args(process->pid, tid, NID::NONE, my_nid);
+        Trace::async_end("after_warp", tid, args);
+      }
+
     } else if (thread->status == Thread::WARP) {
       process->waiting_warp_result.insert(std::make_pair(thread->tid, now));
       process->active_threads.erase(thread->tid);
-      send_command_warp_thread(*thread);
+      // Write out thread before giving pages of it with warp command.
+      thread_master_key.reset();
+      thread->write();
+      thread->memory->write_out();
+      if (Trace::is_enabled()) {
+        picojson::object args = Trace::make_args(process->pid, tid, my_nid, thread->warp_dst);
+        Trace::async_end("wait_safe_point", tid, args);
+      }
+      if (process->warp_batch.tids.find(tid) != process->warp_batch.tids.end()) {
+        // Pages are given when all threads of the batch stop at safe point.
+        process->warp_batch.ready.insert(tid);
+        update_warp_batch(now);
+      } else {
+        send_command_warp_thread(*thread);
+      }
 
     } else if (thread->status == Thread::ERROR) {
       delegate.vmachine_error(*this, "");
 
     } else if (thread->status == Thread::FINISH) {
       thread_master_key.reset();
+      // Batch doesn't wait for the thread finished before reaching safe point.
+      process->warp_batch.tids.erase(tid);
       if (process->destroy_thread(*thread)) {
         finally.clear();
       }
@@ -185,9 +246,9 @@ void VMachine::execute() {
     }
 
     // Send heartbeat, per interval.
-    if ((now - last_heartbeat) > HEARTBEAT_INTERVAL) {
+    if ((now - last_heartbeat) > HEARTBEAT_INTERVAL * 1000) {
       last_heartbeat = now;
-      send_command_heartbeat_vm();
+      send_command_heartbeat_vm(true);
     }
   } catch (Interrupt& e) {
     // Skip thread because waiting to update memroy data.
@@ -195,8 +256,11 @@ void VMachine::execute() {
     vaddr_t waiting_addr = static_cast<InterruptMemoryRequire&>(e).addr;
     Logger::dbg_mem(CoreMid::L1002, "memory need (addr=%s)",
                     Convert::vaddr2str(waiting_addr).c_str());
-    if (waiting_addr != VADDR_NULL) {
-      process->waiting_addr.insert(std::make_pair(tid, waiting_addr));
+    if (waiting_addr != VADDR_NULL &&
+        process->waiting_addr.insert(std::make_pair(tid, waiting_addr)).second) {
+      Process::StallStats& stall = process->stalls[tid];
+      stall.count++;
+      stall.since = now;
     }
   } catch (Error& e) {
     thread->status = Thread::FINISH;
@@ -213,6 +277,89 @@ void VMachine::execute() {
   }
 }
 
+/**
+ * Write active threads and pages of the process to a local file.
+ * Call between execute, when threads are written out and not running.
+ * Pages mastered by other nodes are not written, readable copies are written if with_copies.
+ * @param path Path of checkpoint file.
+ * @param with_copies True if readable copy pages are written too.
+ * @return True if the file is written.
+ */
+bool VMachine::checkpoint(const std::string& path, bool with_copies) {
+  // Take snapshot first, storage of pages is shared until the process write them.
+  std::map<vaddr_t, VMemory::PageImage> images =
+      vmemory.snapshot(Convert::vpid2str(process->pid), with_copies);
+
+  picojson::array threads;
+  for (auto& tid : process->active_threads) {
+    threads.push_back(Convert::vtid2json(tid));
+  }
+
+  picojson::object header;
+  header.insert(std::make_pair("pid", Convert::vpid2json(process->pid)));
+  header.insert(std::make_pair("root_tid", Convert::vtid2json(process->root_tid)));
+  header.insert(std::make_pair("name", picojson::value(process->name)));
+  header.insert(std::make_pair("threads", picojson::value(threads)));
+
+  std::ofstream ofs(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  ofs << picojson::value(header).serialize() << '\n';
+  VMemory::write_image(images, ofs);
+  ofs.close();
+
+  if (ofs.fail()) {
+    Logger::warn(CoreMid::L1008, path.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Restore pages and threads of the process from a file written by checkpoint.
+ * Call after initialize with the same process-id and root thread-id.
+ * This node becomes master of restored pages, threads are resumed at written status.
+ * @param path Path of checkpoint file.
+ * @return True if the process is restored.
+ */
+bool VMachine::restore(const std::string& path) {
+  std::ifstream ifs(path, std::ios::in | std::ios::binary);
+  std::string line;
+  if (!std::getline(ifs, line)) {
+    Logger::warn(CoreMid::L1009, path.c_str(), "can't read");
+    return false;
+  }
+
+  picojson::value js_header;
+  std::string err = picojson::parse(js_header, line);
+  if (!err.empty() || !js_header.is<picojson::object>()) {
+    Logger::warn(CoreMid::L1009, path.c_str(), "broken header");
+    return false;
+  }
+  const picojson::object& header = js_header.get<picojson::object>();
+  if (Convert::json2vpid(header.at("pid")) != process->pid ||
+      Convert::json2vtid(header.at("root_tid")) != process->root_tid) {
+    Logger::warn(CoreMid::L1009, path.c_str(), "another process");
+    return false;
+  }
+
+  try {
+    vmemory.read_image(Convert::vpid2str(process->pid), ifs);
+  } catch (Error& e) {
+    Logger::warn(CoreMid::L1009, path.c_str(), "broken image");
+    return false;
+  }
+
+  // Thread information is read from restored pages.
+  process->name = header.at("name").get<std::string>();
+  process->threads.clear();
+  for (auto& it_thread : header.at("threads").get<picojson::array>()) {
+    vtid_t tid = Convert::json2vtid(it_thread);
+    process->active_threads.insert(tid);
+    process->get_thread(tid);
+  }
+  process_change_thread_set(*process);
+  return true;
+}
+
 /**
  * Tell memory is update by other node.
  * @param addr Updated page address.
@@ -220,9 +367,22 @@ void VMachine::execute() {
 void VMachine::on_recv_update(vaddr_t addr) {
   assert(addr == VMemory::get_upper_addr(addr));
 
+  uint64_t now = Util::get_clock_ms();
   auto it_waiting = process->waiting_addr.begin();
   while (it_waiting != process->waiting_addr.end()) {
     if (it_waiting->second == addr) {
+      auto it_stall = process->stalls.find(it_waiting->first);
+      if (it_stall != process->stalls.end() && it_stall->second.since != 0) {
+        if (Trace::is_enabled()) {
+          picojson::object args = Trace::make_args(process->pid, it_waiting->first,
+                                                   NID::NONE, my_nid);
+          args.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
+          Trace::complete("memory_require", it_waiting->first,
+                          Trace::get_time_us() - (now - it_stall->second.since) * 1000, args);
+        }
+        it_stall->second.time += now - it_stall->second.since;
+        it_stall->second.since = 0;
+      }
       it_waiting = process->waiting_addr.erase(it_waiting);
 
     } else {
@@ -238,12 +398,27 @@ void VMachine::on_recv_update(vaddr_t addr) {
 void VMachine::recv_command(const CommandPacket& packet) {
   const std::string& command = packet.content.at("command").get<std::string>();
 
-  if (command == "heartbeat_vm") {
+  if (command == "checkpoint") {
+    recv_command_checkpoint(packet);
+
+  } else if (command == "heartbeat_vm") {
     recv_command_heartbeat_vm(packet);
 
+  } else if (command == "query_stats") {
+    recv_command_query_stats(packet);
+
+  } else if (command == "require_warp_process") {
+    recv_command_require_warp_process(packet);
+
   } else if (command == "require_warp_thread") {
     recv_command_require_warp_thread(packet);
 
+  } else if (command == "warp_precopy") {
+    recv_command_warp_precopy(packet);
+
+  } else if (command == "warp_process") {
+    recv_command_warp_process(packet);
+
   } else if (command == "warp_thread") {
     recv_command_warp_thread(packet);
 
@@ -301,6 +476,50 @@ void VMachine::regist_builtin_func(const std::string& name,
   builtin_funcs.insert(std::make_pair(name, std::make_pair(func, param)));
 }
 
+/**
+ * Get statistics of memory and time threads waited memory in this VM.
+ * @return Statistics.
+ */
+picojson::object VMachine::get_stats() {
+  uint64_t now = Util::get_clock_ms();
+  picojson::object threads;
+  for (auto& it_stall : process->stalls) {
+    const Process::StallStats& stall = it_stall.second;
+    picojson::object thread;
+    thread.insert(std::make_pair("count", Convert::int2json(stall.count)));
+    thread.insert(std::make_pair("time", Convert::int2json
+                                 (stall.time + (stall.since == 0 ? 0 : now - stall.since))));
+    threads.insert(std::make_pair(Convert::vtid2str(it_stall.first), picojson::value(thread)));
+  }
+
+  picojson::object stats;
+  stats.insert(std::make_pair("memory", picojson::value
+                              (vmemory.get_stats(Convert::vpid2str(process->pid)))));
+  stats.insert(std::make_pair("stalls", picojson::value(threads)));
+  return stats;
+}
+
+/**
+ * When receive checkpoint command, require to write the process to a local file.
+ * The file is written after threads stop, the result is replied by checkpoint_result command.
+ * @param packet Command packet, containing path of file and with_copies flag (optional).
+ */
+void VMachine::recv_command_checkpoint(const CommandPacket& packet) {
+  const std::string& path = packet.content.at("path").get<std::string>();
+  if (!checkpoint_request.path.empty()) {
+    send_command_checkpoint_result(packet.src_nid, path, false, "busy");
+    return;
+  }
+
+  auto it_with_copies = packet.content.find("with_copies");
+  checkpoint_request.path = path;
+  checkpoint_request.with_copies =
+      it_with_copies != packet.content.end() && it_with_copies->second.get<bool>();
+  checkpoint_request.src_nid = packet.src_nid;
+  checkpoint_request.since = Util::get_clock_ms();
+  progress_checkpoint(checkpoint_request.since);
+}
+
 /**
  * When receive heartbeat_vm command, remove thread-id from waiting list if exisiting.
  * @param packet Command packet.
@@ -310,7 +529,11 @@ void VMachine::recv_command_heartbeat_vm(const CommandPacket& packet) {
 
   for (auto& it_thread : packet.content.at("threads").get<picojson::array>()) {
     vtid_t tid = Convert::json2vtid(it_thread);
-    process->waiting_warp_result.erase(tid);
+    process->warp_bundles.erase(tid);
+    if (process->waiting_warp_result.erase(tid) != 0 && Trace::is_enabled()) {
+      picojson::object args = Trace::make_args(process->pid, tid, my_nid, packet.src_nid);
+      Trace::async_end("warp", tid, args);
+    }
     /// @todo remove from threads?
 
     if (process->active_threads.find(tid) != process->active_threads.end()) {
@@ -320,6 +543,64 @@ void VMachine::recv_command_heartbeat_vm(const CommandPacket& packet) {
   }
 }
 
+/**
+ * When receive query_stats command, reply statistics of memory and threads by stats command.
+ * @param packet Command packet.
+ */
+void VMachine::recv_command_query_stats(const CommandPacket& packet) {
+  picojson::object param;
+  param.insert(std::make_pair("stats", picojson::value(get_stats())));
+  send_command(process->pid, packet.src_nid, Module::CONTROLLER, "stats", param);
+}
+
+/**
+ * When receive require_warp_process command, setup to warp all threads in this node together.
+ * Threads not running normally now, and threads already required to warp are left.
+ * Pre-copy of threads is taken over by the batch.
+ * @param packet Command packet, containing target node-id.
+ */
+void VMachine::recv_command_require_warp_process(const CommandPacket& packet) {
+  const nid_t& target_nid = Convert::json2nid(packet.content.at("target_nid"));
+  assert(target_nid != NID::NONE);
+
+  Process::WarpBatch& batch = process->warp_batch;
+  // Skip if another batch is running.
+  if (batch.dst_nid != NID::NONE) return;
+
+  for (auto tid : process->active_threads) {
+    Thread& thread = process->get_thread(tid);
+    if (!thread.require_warp(target_nid)) continue;
+    thread.write();
+    thread.memory->write_out();
+    batch.tids.insert(tid);
+
+    auto it_precopy = process->precopies.find(tid);
+    if (it_precopy != process->precopies.end()) {
+      batch.precopied.insert(it_precopy->second.sent.begin(), it_precopy->second.sent.end());
+      process->precopies.erase(it_precopy);
+    }
+
+    if (Trace::is_enabled()) {
+      picojson::object args = Trace::make_args(process->pid, tid, my_nid, target_nid);
+      Trace::async_begin("warp", tid, args);
+      Trace::async_begin("wait_safe_point", tid, args);
+    }
+  }
+
+  if (batch.tids.empty()) {
+    batch.precopied.clear();
+    return;
+  }
+  batch.dst_nid = target_nid;
+  batch.time = 0;
+  if (Trace::is_enabled()) {
+    picojson::object args = Trace::make_args(process->pid, process->root_tid, my_nid, target_nid);
+    args.insert(std::make_pair("threads", picojson::value(static_cast<double>
+                                                          (batch.tids.size()))));
+    Trace::async_begin("warp_process", process->root_tid, args);
+  }
+}
+
 /**
  * When receive require_warp_thread command, setup to warp thread.
  * @param packet Command packet, containing target thread-id and node-id.
@@ -329,15 +610,81 @@ void VMachine::recv_command_require_warp_thread(const CommandPacket& packet) {
   const nid_t& target_nid = Convert::json2nid(packet.content.at("target_nid"));
   assert(target_nid != NID::NONE);
 
-  if (process->active_threads.find(tid) != process->active_threads.end()) {
+  if (process->active_threads.find(tid) != process->active_threads.end() &&
+      process->warp_batch.tids.find(tid) == process->warp_batch.tids.end()) {
     Thread& thread = process->get_thread(tid);
-    if (thread.require_warp(target_nid)) {
+    auto it_precopy = thread.warp_parameter.find(PW_KEY_WARP_PRECOPY);
+    if (it_precopy != thread.warp_parameter.end() && it_precopy->second == PW_VAL_PRECOPY_ON &&
+        thread.status == Thread::NORMAL) {
+      // Thread keeps running while pages are sent to the destination by rounds.
+      Process::Precopy& precopy = process->precopies[tid];
+      precopy.dst_nid = target_nid;
+      precopy.sent.clear();
+      precopy.round = 0;
+      precopy.time = 0;
+      precopy.is_required = false;
+      if (Trace::is_enabled()) {
+        picojson::object args = Trace::make_args(process->pid, tid, my_nid, target_nid);
+        Trace::async_begin("warp", tid, args);
+      }
+
+    } else if (thread.require_warp(target_nid)) {
       thread.write();
       thread.memory->write_out();
+      if (Trace::is_enabled()) {
+        picojson::object args = Trace::make_args(process->pid, tid, my_nid, target_nid);
+        Trace::async_begin("warp", tid, args);
+        Trace::async_begin("wait_safe_point", tid, args);
+      }
     }
   }
 }
 
+/**
+ * When receive warp_precopy command, store copy of pages sent before warp of a thread.
+ * @param packet Command packet.
+ */
+void VMachine::recv_command_warp_precopy(const CommandPacket& packet) {
+  vmemory.recv_bundle(Convert::vpid2str(packet.pid),
+                      Convert::json2nid(packet.content.at("src_nid")),
+                      packet.content.at("bundle").get<picojson::array>(),
+                      Convert::json2vtid(packet.content.at("tid")));
+}
+
+/**
+ * When receive warp_process command, store pages given by the source node at once, and
+ * activate threads warped together. Warp is reported by one heartbeat_vm command.
+ * @param packet Command packet.
+ */
+void VMachine::recv_command_warp_process(const CommandPacket& packet) {
+  uint64_t start = Trace::get_time_us();
+  const nid_t& src_nid = Convert::json2nid(packet.content.at("src_nid"));
+  const picojson::value& bundle = packet.content.at("bundle");
+  vmemory.recv_bundle(Convert::vpid2str(packet.pid), src_nid, bundle.get<picojson::array>());
+
+  std::set<vtid_t> tids;
+  for (auto& it_tid : packet.content.at("tids").get<picojson::array>()) {
+    tids.insert(Convert::json2vtid(it_tid));
+  }
+
+  if (Trace::is_enabled()) {
+    picojson::object args = Trace::make_args(process->pid, process->root_tid, src_nid, my_nid);
+    args.insert(std::make_pair("bytes", picojson::value(static_cast<double>
+                                                        (bundle.serialize().size()))));
+    args.insert(std::make_pair("threads", picojson::value(static_cast<double>(tids.size()))));
+    Trace::complete("recv_bundle", process->root_tid, start, args);
+    for (auto tid : tids) {
+      picojson::object thread_args = Trace::make_args(process->pid, tid, src_nid, my_nid);
+      Trace::async_begin("after_warp", tid, thread_args);
+    }
+  }
+  // Parts of large bundle carry no thread, threads are activated by the last part.
+  if (!tids.empty()) {
+    vmemory.release_precopied(Convert::vpid2str(packet.pid), src_nid, tids);
+    process->warp_out_threads(tids);
+  }
+}
+
 /**
  * When receive warp_thread command, activate thread and tell it to another node by
  * sending heartbeat_vm thread.
@@ -345,6 +692,27 @@ void VMachine::recv_command_require_warp_thread(const CommandPacket& packet) {
  */
 void VMachine::recv_command_warp_thread(const CommandPacket& packet) {
   vtid_t tid = Convert::json2vtid(packet.content.at("tid"));
+  uint64_t start = Trace::get_time_us();
+  auto it_bundle = packet.content.find("bundle");
+  if (it_bundle != packet.content.end()) {
+    const nid_t& src_nid = Convert::json2nid(packet.content.at("src_nid"));
+    vmemory.recv_bundle(Convert::vpid2str(packet.pid), src_nid,
+                        it_bundle->second.get<picojson::array>());
+    vmemory.release_precopied(Convert::vpid2str(packet.pid), src_nid, std::set<vtid_t>({tid}));
+  }
+  if (Trace::is_enabled()) {
+    auto it_src = packet.content.find("src_nid");
+    picojson::object args = Trace::make_args(process->pid, tid, it_src == packet.content.end() ?
+                                             NID::NONE : Convert::json2nid(it_src->second),
+                                             my_nid);
+    if (it_bundle != packet.content.end()) {
+      args.insert(std::make_pair("bytes", picojson::value(static_cast<double>
+                                                          (it_bundle->second.serialize().
+                                                           size()))));
+    }
+    Trace::complete("recv_bundle", tid, start, args);
+    Trace::async_begin("after_warp", tid, args);
+  }
   process->warp_out_thread(tid);
   send_command_heartbeat_vm();
 }
@@ -366,18 +734,48 @@ void VMachine::send_command(const vpid_t& pid, const nid_t& dst_nid, Module::Typ
   delegate.vmachine_send_command(*this, {pid, dst_nid, NID::NONE, module, param});
 }
 
+/**
+ * Send checkpoint_result command to the node required checkpoint.
+ * @param dst_nid Destination node-id.
+ * @param path Path of checkpoint file.
+ * @param result True if the file is written.
+ * @param reason Reason of failure, empty if written.
+ */
+void VMachine::send_command_checkpoint_result(const nid_t& dst_nid, const std::string& path,
+                                              bool result, const std::string& reason) {
+  picojson::object param;
+  param.insert(std::make_pair("path", picojson::value(path)));
+  param.insert(std::make_pair("result", picojson::value(result)));
+  param.insert(std::make_pair("reason", picojson::value(reason)));
+  send_command(process->pid, dst_nid, Module::CONTROLLER, "checkpoint_result", param);
+}
+
 /**
  * Send heartbeat_vm command to tell thread list having this VM module.
+ * Working sets of threads and statistics are sent to scheduler by periodic heartbeat only.
+ * @param is_periodic True if sent per HEARTBEAT_INTERVAL, false if sent when threads change.
  */
-void VMachine::send_command_heartbeat_vm() {
-  // List up activate thread.
+void VMachine::send_command_heartbeat_vm(bool is_periodic) {
+  // List up activate thread with pages they would give with warp.
   picojson::array threads;
+  picojson::object working_sets;
   for (auto& it_thread : process->threads) {
     Thread& thread = *it_thread.second;
     if (thread.status == Thread::NORMAL ||
         thread.status == Thread::AFTER_WARP ||
         thread.status == Thread::JOIN_WAIT) {
       threads.push_back(Convert::vtid2json(it_thread.first));
+      if (!is_periodic) continue;
+
+      uint64_t pages, bytes;
+      thread.memory->estimate_warp(get_warp_pages(thread), pages, bytes);
+      picojson::object working_set;
+      working_set.insert(std::make_pair("pages", Convert::int2json(pages)));
+      working_set.insert(std::make_pair("bytes", Convert::int2json(bytes)));
+      working_set.insert(std::make_pair("depth", Convert::int2json
+                                        (static_cast<uint64_t>(thread.stack.size()))));
+      working_sets.insert(std::make_pair(Convert::vtid2str(it_thread.first),
+                                         picojson::value(working_set)));
     }
   }
 
@@ -385,27 +783,306 @@ void VMachine::send_command_heartbeat_vm() {
   param.insert(std::make_pair("name", picojson::value(process->name)));
   param.insert(std::make_pair("threads", picojson::value(threads)));
   send_command(process->pid, NID::BROADCAST, Module::VM, "heartbeat_vm", param);
+
+  // Scanning pages for statistics is heavy, they are sent to scheduler only per long interval.
+  if (is_periodic) {
+    param.insert(std::make_pair("working_sets", picojson::value(working_sets)));
+    uint64_t now = Util::get_clock_ms();
+    if (now - last_stats > HEARTBEAT_STATS_INTERVAL * 1000) {
+      last_stats = now;
+      param.insert(std::make_pair("stats", picojson::value(get_stats())));
+    }
+  }
   send_command(process->pid, NID::BROADCAST, Module::SCHEDULER, "heartbeat_vm", param);
 }
 
+/**
+ * Send warp_precopy command to SCHEDULER at warp destination node.
+ * @param thread Target thread to warp.
+ * @param dst_nid Warp destination node-id.
+ * @param bundle Copy of pages made by VMemory::Accessor::copy_bundle.
+ */
+void VMachine::send_command_warp_precopy(Thread& thread, const nid_t& dst_nid,
+                                         picojson::array& bundle) {
+  picojson::object param = make_warp_param(dst_nid);
+  param.insert(std::make_pair("tid", Convert::vtid2json(thread.tid)));
+  param.insert(std::make_pair("bundle", picojson::value(bundle)));
+
+  send_command(process->pid, dst_nid, Module::SCHEDULER, "warp_precopy", param);
+}
+
+/**
+ * Send warp_process command to SCHEDULER at warp destination node for threads of the batch
+ * not reported as warped yet.
+ * Pages the threads need to resume are given first, then all other pages this node is master
+ * of if no thread is left in this node. Each page is given once even if threads share it.
+ * Pages are given by the first call, and the same parameters of give are resent after it.
+ * Large bundle is sent by some commands, threads are sent with the last part.
+ */
+void VMachine::send_command_warp_process() {
+  Process::WarpBatch& batch = process->warp_batch;
+  uint64_t start = Trace::get_time_us();
+
+  picojson::array tids;
+  for (auto tid : batch.tids) {
+    if (process->waiting_warp_result.find(tid) == process->waiting_warp_result.end()) continue;
+    tids.push_back(Convert::vtid2json(tid));
+    if (batch.time != 0) continue;
+    Thread& thread = process->get_thread(tid);
+    // Pages given with the previous thread are not master now, and are skipped.
+    picojson::array pages =
+        thread.memory->give_bundle(get_warp_pages(thread), batch.dst_nid, batch.precopied);
+    batch.bundle.insert(batch.bundle.end(), pages.begin(), pages.end());
+  }
+  if (batch.time != 0) {
+    vmemory.filter_given(Convert::vpid2str(process->pid), batch.dst_nid, batch.bundle);
+  } else if (process->active_threads.empty()) {
+    picojson::array pages = process->proc_memory->give_space(batch.dst_nid, batch.precopied);
+    batch.bundle.insert(batch.bundle.end(), pages.begin(), pages.end());
+  }
+
+  uint64_t sent_bytes = 0;
+  picojson::array part;
+  uint64_t part_bytes = 0;
+  auto send_part = [&](picojson::array& part_tids) {
+    picojson::object param = make_warp_param(batch.dst_nid);
+    param.insert(std::make_pair("tids", picojson::value(part_tids)));
+    param.insert(std::make_pair("bundle", picojson::value(part)));
+    if (Trace::is_enabled()) sent_bytes += param.at("bundle").serialize().size();
+    send_command(process->pid, batch.dst_nid, Module::SCHEDULER, "warp_process", param);
+    part.clear();
+    part_bytes = 0;
+  };
+
+  picojson::array no_tids;
+  for (auto& give : batch.bundle) {
+    const picojson::object& content = give.get<picojson::object>();
+    auto it_value = content.find("value");
+    uint64_t bytes = it_value == content.end() ? 0 :
+        it_value->second.get<std::string>().size() / 2;
+    if (!part.empty() && part_bytes + bytes > VMemoryWarp::BUNDLE_BYTES) send_part(no_tids);
+    part.push_back(give);
+    part_bytes += bytes;
+  }
+  send_part(tids);
+
+  if (Trace::is_enabled()) {
+    picojson::object args = Trace::make_args(process->pid, process->root_tid, my_nid,
+                                             batch.dst_nid);
+    args.insert(std::make_pair("bytes", picojson::value(static_cast<double>(sent_bytes))));
+    args.insert(std::make_pair("threads", picojson::value(static_cast<double>(tids.size()))));
+    Trace::complete("send_warp_process", process->root_tid, start, args);
+  }
+}
+
 /**
  * Send warp_thread command to SCHEDULER at warp destination node.
+ * Pages of thread, call stack, and pages accessed recently are given to the destination by
+ * the command, so that the thread resumes without requiring them one by one.
+ * Pages are given by the first command, resent command carries the same parameters of give.
  * @param thread Target thread to warp.
  */
 void VMachine::send_command_warp_thread(Thread& thread) {
   assert(thread.warp_dst != NID::NONE);
+  uint64_t start = Trace::get_time_us();
+
+  auto it_bundle = process->warp_bundles.find(thread.tid);
+  if (it_bundle == process->warp_bundles.end()) {
+    std::set<vaddr_t> precopied;
+    auto it_precopy = process->precopies.find(thread.tid);
+    if (it_precopy != process->precopies.end()) {
+      precopied.swap(it_precopy->second.sent);
+      process->precopies.erase(it_precopy);
+    }
+    it_bundle = process->warp_bundles.insert
+        (std::make_pair(thread.tid, thread.memory->give_bundle(get_warp_pages(thread),
+                                                               thread.warp_dst, precopied))).
+        first;
+
+  } else {
+    vmemory.filter_given(Convert::vpid2str(process->pid), thread.warp_dst, it_bundle->second);
+  }
+
+  picojson::object param = make_warp_param(thread.warp_dst);
+  param.insert(std::make_pair("tid", Convert::vtid2json(thread.tid)));
+  param.insert(std::make_pair("bundle", picojson::value(it_bundle->second)));
+
+  if (Trace::is_enabled()) {
+    picojson::object args = Trace::make_args(process->pid, thread.tid, my_nid, thread.warp_dst);
+    args.insert(std::make_pair("bytes", picojson::value(static_cast<double>
+                                                        (param.at("bundle").serialize().size()))));
+    Trace::complete("send_warp_thread", thread.tid, start, args);
+  }
+  send_command(process->pid, thread.warp_dst, Module::SCHEDULER, "warp_thread", param);
+}
 
+/**
+ * Make parameter of commands to warp destination, containing information to create VM.
+ * @param dst_nid Warp destination node-id.
+ * @return Parameter of command.
+ */
+picojson::object VMachine::make_warp_param(const nid_t& dst_nid) {
   picojson::object param;
   param.insert(std::make_pair("root_tid", Convert::vtid2json(process->root_tid)));
   param.insert(std::make_pair("proc_addr", Convert::vaddr2json(process->addr)));
   param.insert(std::make_pair("master_nid", Convert::nid2json
                               (process->proc_memory->get_master(process->addr))));
   param.insert(std::make_pair("name", picojson::value(process->name)));
-  param.insert(std::make_pair("tid", Convert::vtid2json(thread.tid)));
-  param.insert(std::make_pair("dst_nid", Convert::nid2json(thread.warp_dst)));
+  param.insert(std::make_pair("dst_nid", Convert::nid2json(dst_nid)));
   param.insert(std::make_pair("src_nid", Convert::nid2json(my_nid)));
+  return param;
+}
 
-  send_command(process->pid, thread.warp_dst, Module::SCHEDULER, "warp_thread", param);
+/**
+ * Get addresses of pages a thread needs to resume, thread information, call stack, and
+ * stack area of each function.
+ * @param thread Target thread.
+ * @return Addresses of pages.
+ */
+std::vector<vaddr_t> VMachine::get_warp_pages(Thread& thread) {
+  std::vector<vaddr_t> addrs;
+  addrs.push_back(thread.tid);
+  addrs.insert(addrs.end(), thread.stack.begin(), thread.stack.end());
+  for (auto& it_stackinfo : thread.stackinfos) {
+    const StackInfo& stackinfo = *it_stackinfo.second;
+    addrs.push_back(stackinfo.stack);
+    addrs.push_back(stackinfo.var_arg);
+    addrs.insert(addrs.end(), stackinfo.alloca_addrs.begin(), stackinfo.alloca_addrs.end());
+  }
+  return addrs;
+}
+
+/**
+ * Send pages of a thread to warp destination as a round of pre-copy.
+ * Thread is required to warp when bytes not sent yet become few or rounds reach the limit.
+ * @param thread Target thread.
+ * @param precopy State of pre-copy for the thread.
+ * @param now Current time (msec).
+ */
+void VMachine::precopy_thread(Thread& thread, Process::Precopy& precopy, uint64_t now) {
+  uint64_t start = Trace::get_time_us();
+  uint64_t dirty;
+  picojson::array bundle =
+      thread.memory->copy_bundle(get_warp_pages(thread), precopy.dst_nid, precopy.sent, dirty);
+  if (!bundle.empty()) {
+    send_command_warp_precopy(thread, precopy.dst_nid, bundle);
+  }
+  if (Trace::is_enabled()) {
+    picojson::object args = Trace::make_args(process->pid, thread.tid, my_nid, precopy.dst_nid);
+    args.insert(std::make_pair("round", picojson::value(static_cast<double>(precopy.round))));
+    args.insert(std::make_pair("bytes", picojson::value(static_cast<double>
+                                                        (picojson::value(bundle).serialize().
+                                                         size()))));
+    args.insert(std::make_pair("dirty", picojson::value(static_cast<double>(dirty))));
+    Trace::complete("precopy", thread.tid, start, args);
+  }
+  precopy.round++;
+  precopy.time = now;
+
+  if (dirty > VMemoryWarp::PRECOPY_THRESHOLD && precopy.round < VMemoryWarp::PRECOPY_ROUNDS) {
+    return;
+  }
+  if (thread.require_warp(precopy.dst_nid)) {
+    precopy.is_required = true;
+    thread.write();
+    thread.memory->write_out();
+    if (Trace::is_enabled()) {
+      picojson::object args = Trace::make_args(process->pid, thread.tid, my_nid, precopy.dst_nid);
+      Trace::async_begin("wait_safe_point", thread.tid, args);
+    }
+  }
+}
+
+/**
+ * Proceed warp of threads together.
+ * Send warp_process command when all threads of the batch stop at safe point, resend it per
+ * interval, and finish the batch when the destination reports all threads.
+ * @param now Current time (msec).
+ */
+void VMachine::update_warp_batch(uint64_t now) {
+  Process::WarpBatch& batch = process->warp_batch;
+  if (batch.dst_nid == NID::NONE) return;
+
+  bool is_waiting = false;
+  for (auto tid : batch.tids) {
+    if (process->waiting_warp_result.find(tid) != process->waiting_warp_result.end()) {
+      is_waiting = true;
+      break;
+    }
+  }
+
+  if (batch.time == 0) {
+    // Wait for other threads to stop at safe point.
+    if (batch.ready.size() < batch.tids.size()) return;
+    if (is_waiting) {
+      send_command_warp_process();
+      batch.time = now;
+      return;
+    }
+
+  } else if (is_waiting) {
+    if (batch.time + WARP_RESEND_INTERVAL < now) {
+      send_command_warp_process();
+      batch.time = now;
+    }
+    return;
+  }
+
+  if (Trace::is_enabled()) {
+    picojson::object args = Trace::make_args(process->pid, process->root_tid, my_nid,
+                                             batch.dst_nid);
+    Trace::async_end("warp_process", process->root_tid, args);
+  }
+  batch.dst_nid = NID::NONE;
+  batch.tids.clear();
+  batch.ready.clear();
+  batch.precopied.clear();
+  batch.bundle.clear();
+  batch.time = 0;
+}
+
+/**
+ * Write checkpoint required by command when all threads stop, and reply the result.
+ * Threads running normally are stopped by execute, others are waited until timeout.
+ * Checkpoint is refused if some pages are mastered by other nodes, image without them is broken.
+ * @param now Current time (msec).
+ */
+void VMachine::progress_checkpoint(uint64_t now) {
+  CheckpointRequest& request = checkpoint_request;
+  if (request.path.empty()) return;
+
+  bool is_busy = !process->waiting_addr.empty() || !process->waiting_warp_result.empty() ||
+      !process->waiting_warp_setup.empty() || !process->precopies.empty() ||
+      process->warp_batch.dst_nid != NID::NONE;
+  for (auto tid : process->active_threads) {
+    if (is_busy) break;
+    Thread::Status status = process->get_thread(tid).status;
+    is_busy = status == Thread::WAIT_WARP || status == Thread::BEFOR_WARP ||
+        status == Thread::WARP || status == Thread::AFTER_WARP;
+  }
+
+  if (is_busy && request.since + CHECKPOINT_TIMEOUT >= now) return;
+
+  bool result = false;
+  std::string reason;
+  if (is_busy) {
+    reason = "threads don't stop";
+    Logger::warn(CoreMid::L1010, request.path.c_str(), reason.c_str());
+
+  } else if (!vmemory.is_snapshot_complete(Convert::vpid2str(process->pid),
+                                           request.with_copies)) {
+    reason = "pages on other nodes";
+    Logger::warn(CoreMid::L1010, request.path.c_str(), reason.c_str());
+
+  } else if (checkpoint(request.path, request.with_copies)) {
+    result = true;
+
+  } else {
+    reason = "can't write";
+  }
+
+  send_command_checkpoint_result(request.src_nid, request.path, result, reason);
+  request.path.clear();
 }
 
 /**
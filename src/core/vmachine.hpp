@@ -50,6 +50,8 @@ class VMachine : private ProcessDelegate {
                   const nid_t& master_nid, const std::string& name);
   void initialize_gui(BuiltinGuiDelegate& delegate);
   void execute();
+  bool checkpoint(const std::string& path, bool with_copies);
+  bool restore(const std::string& path);
 
   void on_recv_update(vaddr_t addr);
   void recv_command(const CommandPacket& packet);
@@ -78,18 +80,47 @@ class VMachine : private ProcessDelegate {
   /** Executable threads pool in this node's process. */
   std::queue<vtid_t> loop_queue;
 
-  std::time_t last_heartbeat;
+  /** Checkpoint required by command, waiting threads to stop. */
+  struct CheckpointRequest {
+    /** Path of checkpoint file, empty if no request is waiting. */
+    std::string path;
+    bool with_copies;
+    /** Node-id required checkpoint, the result is replied to it. */
+    nid_t src_nid;
+    /** Time received the request (msec). */
+    uint64_t since;
+  };
+  CheckpointRequest checkpoint_request;
+
+  uint64_t last_heartbeat;
+  /** Time sent statistics with heartbeat at last (msec). */
+  uint64_t last_stats;
 
   void initialize_builtin();
 
+  picojson::object get_stats();
+  void recv_command_checkpoint(const CommandPacket& packet);
   /// @todo Clean up unused thread information.
   void recv_command_heartbeat_vm(const CommandPacket& packet);
+  void recv_command_query_stats(const CommandPacket& packet);
+  void recv_command_require_warp_process(const CommandPacket& packet);
   void recv_command_require_warp_thread(const CommandPacket& packet);
+  void recv_command_warp_precopy(const CommandPacket& packet);
+  void recv_command_warp_process(const CommandPacket& packet);
   void recv_command_warp_thread(const CommandPacket& packet);
 
   void send_command(const vpid_t& pid, const nid_t& dst_nid, Module::Type module,
                     const std::string& command, picojson::object& param);
-  void send_command_heartbeat_vm();
+  void send_command_checkpoint_result(const nid_t& dst_nid, const std::string& path,
+                                      bool result, const std::string& reason);
+  void send_command_heartbeat_vm(bool is_periodic = false);
+  void send_command_warp_precopy(Thread& thread, const nid_t& dst_nid, picojson::array& bundle);
+  void send_command_warp_process();
   void send_command_warp_thread(Thread& thread);
+  picojson::object make_warp_param(const nid_t& dst_nid);
+  std::vector<vaddr_t> get_warp_pages(Thread& thread);
+  void precopy_thread(Thread& thread, Process::Precopy& precopy, uint64_t now);
+  void update_warp_batch(uint64_t now);
+  void progress_checkpoint(uint64_t now);
 };
 }  // namespace processwarp
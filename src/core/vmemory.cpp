@@ -1,8 +1,13 @@
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <deque>
+#include <istream>
+#include <ostream>
 #include <set>
 #include <string>
+#include <type_traits>
 
 #include "constant.hpp"
 #include "constant_vm.hpp"
@@ -35,6 +40,63 @@ const vaddr_t VMemory::UPPER_MASKS[]  = {
   0xFFFFFFFFFFFFFFFF,  // Function, Type
 };
 
+/**
+ * Execute atomic read-modify-write operation for an integer.
+ * @param ptr Pointer to the integer.
+ * @param type Kind of operation.
+ * @param operand Pointer to operand.
+ * @param compare Pointer to value to compare for AT_CMPXCHG.
+ */
+template <typename S> static void compute_atomic(uint8_t* ptr, VMemory::AtomicType type,
+                                                 const uint8_t* operand, const uint8_t* compare) {
+  typedef typename std::make_unsigned<S>::type U;
+  U old;
+  U val;
+  std::memcpy(&old, ptr, sizeof(U));
+  std::memcpy(&val, operand, sizeof(U));
+
+  U res = old;
+  switch (type) {
+    case VMemory::AT_XCHG: res = val; break;
+    case VMemory::AT_ADD:  res = old + val; break;
+    case VMemory::AT_SUB:  res = old - val; break;
+    case VMemory::AT_AND:  res = old & val; break;
+    case VMemory::AT_NAND: res = ~(old & val); break;
+    case VMemory::AT_OR:   res = old | val; break;
+    case VMemory::AT_XOR:  res = old ^ val; break;
+    case VMemory::AT_MAX:  res = static_cast<S>(old) > static_cast<S>(val) ? old : val; break;
+    case VMemory::AT_MIN:  res = static_cast<S>(old) < static_cast<S>(val) ? old : val; break;
+    case VMemory::AT_UMAX: res = old > val ? old : val; break;
+    case VMemory::AT_UMIN: res = old < val ? old : val; break;
+    case VMemory::AT_CMPXCHG: {
+      if (std::memcmp(&old, compare, sizeof(U)) == 0) res = val;
+    } break;
+  }
+  std::memcpy(ptr, &res, sizeof(U));
+}
+
+/**
+ * Write a value to binary image.
+ * @param os Stream to write.
+ * @param value Value to write.
+ */
+template <typename T> static void write_raw(std::ostream& os, T value) {
+  os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/**
+ * Read a value from binary image.
+ * @param is Stream to read.
+ * @return Read value.
+ */
+template <typename T> static T read_raw(std::istream& is) {
+  T value;
+  if (!is.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+    throw_error_message(Error::PARSE, "broken memory image");
+  }
+  return value;
+}
+
 /**
  * Simple destructor for vtable.
  */
@@ -45,7 +107,9 @@ VMemoryDelegate::~VMemoryDelegate() {
 VMemory::VMemory(VMemoryDelegate& delegate_, const nid_t& nid_) :
     my_nid(nid_),
     rnd(std::random_device()()),
-    delegate(delegate_) {
+    delegate(delegate_),
+    is_lease_shared(false),
+    policy(new DefaultMigrationPolicy()) {
 }
 
 /**
@@ -55,8 +119,19 @@ VMemory::VMemory(VMemoryDelegate& delegate_, const nid_t& nid_) :
 void VMemory::recv_command(const CommandPacket& packet) {
   if (packet.src_nid == my_nid) return;
   const std::string& command = packet.content.at("command").get<std::string>();
+  learn_partition(packet.src_nid);
+  auto it_space = spaces.find(packet.pid);
+  if (it_space != spaces.end()) {
+    count_message(it_space->second->stats.recv, command, packet.content);
+  }
+
+  if (command == "atomic") {
+    recv_command_atomic(packet);
+
+  } else if (command == "atomic_reply") {
+    recv_command_atomic_reply(packet);
 
-  if (command == "copy") {
+  } else if (command == "copy") {
     recv_command_copy(packet);
 
   } else if (command == "copy_reply") {
@@ -65,9 +140,15 @@ void VMemory::recv_command(const CommandPacket& packet) {
   } else if (command == "require") {
     recv_command_require(packet);
 
+  } else if (command == "require_batch") {
+    recv_command_require_batch(packet);
+
   } else if (command == "update") {
     recv_command_update(packet);
 
+  } else if (command == "update_reply") {
+    recv_command_update_reply(packet);
+
   } else if (command == "reserve") {
     recv_command_reserve(packet);
 
@@ -92,6 +173,153 @@ void VMemory::recv_command(const CommandPacket& packet) {
   }
 }
 
+/**
+ * When receive atomic command, execute the operation if this node is master of target address,
+ * and reply old and new value to the node that began the operation.
+ * Relay atomic command to master node if this node isn't master.
+ * @param packet Command packet containing target address and operation.
+ */
+void VMemory::recv_command_atomic(const CommandPacket& packet) {
+  vaddr_t addr = Convert::json2vaddr(packet.content.at("addr"));
+  AtomicType type = static_cast<AtomicType>(Convert::json2int<int>(packet.content.at("op")));
+  const std::string& operand = Convert::json2bin(packet.content.at("value"));
+  auto it_compare = packet.content.find("compare");
+  const std::string& compare = it_compare == packet.content.end() ?
+      std::string() : Convert::json2bin(it_compare->second);
+  uint64_t serial = Convert::json2int<uint64_t>(packet.content.at("serial"));
+  auto it_origin = packet.content.find("origin");
+  const nid_t& origin = it_origin == packet.content.end() ?
+      packet.src_nid : Convert::json2nid(it_origin->second);
+
+  auto it_space = spaces.find(packet.pid);
+  if (it_space == spaces.end()) {
+    // Origin resends it to the master known at that time.
+    Logger::warn(CoreMid::L1011, "atomic", Convert::vaddr2str(addr).c_str());
+    return;
+  }
+
+  Space& space = *it_space->second;
+  auto it_page = space.pages.find(get_upper_addr(addr));
+  if (it_page == space.pages.end()) {
+    // Copy kept after giving master was evicted, master is remembered in the directory.
+    nid_t master = get_location(space, get_upper_addr(addr));
+    if (master == NID::BROADCAST) {
+      Logger::warn(CoreMid::L1011, "atomic", Convert::vaddr2str(addr).c_str());
+    } else {
+      send_command_atomic(master, space, addr, type, operand, compare, serial, origin);
+    }
+    return;
+  }
+
+  Page& page = it_page->second;
+  if (page.type == PT_MASTER) {
+    std::map<uint64_t, picojson::object>& replies = space.atomic_replies[origin];
+    auto it_reply = replies.find(serial);
+    if (it_reply != replies.end()) {
+      // Operation resent because the reply was lost, it was executed already.
+      send_memory_command(space.name, origin, "atomic_reply", it_reply->second);
+      return;
+    }
+
+    std::string old = apply_atomic(page, get_lower_addr(addr), type, operand, compare);
+    update_master(space, page, get_upper_addr(addr), get_lower_addr(addr), operand.size());
+
+    if (origin != my_nid) {
+      // Reply after copies, so the new value isn't overwritten by older copy.
+      picojson::object& param = replies[serial];
+      param.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
+      param.insert(std::make_pair("serial", Convert::int2json(serial)));
+      param.insert(std::make_pair("old", Convert::bin2json(
+          reinterpret_cast<const uint8_t*>(old.data()), old.size())));
+      param.insert(std::make_pair("value", Convert::bin2json(
+          page.value.get_readonly() + get_lower_addr(addr), operand.size())));
+      send_memory_command(space.name, origin, "atomic_reply", param);
+      if (replies.size() > VMemoryAtomic::REPLIES) replies.erase(replies.begin());
+    }
+
+    // Relaying node didn't write the page, count the write for the node began it.
+    page.stats.record_remote_write(origin);
+    if (page.master_count == 0 && origin != my_nid &&
+        policy->should_give_on_write(page.stats, origin)) {
+      give_master(space, page, get_upper_addr(addr), origin);
+    }
+
+    delegate.vmemory_recv_update(*this, get_upper_addr(addr));
+
+  } else if (page.type == PT_COPY) {
+    send_command_atomic(*page.hint.begin(), space, addr, type, operand, compare, serial, origin);
+
+  } else {
+    /// @todo error
+    assert(false);
+  }
+}
+
+/**
+ * When receive atomic reply command, keep old value for the thread waiting for it,
+ * and apply new value to the copy of this node.
+ * @param packet Command packet containing target address, serial number and values.
+ */
+void VMemory::recv_command_atomic_reply(const CommandPacket& packet) {
+  vaddr_t addr = Convert::json2vaddr(packet.content.at("addr"));
+  uint64_t serial = Convert::json2int<uint64_t>(packet.content.at("serial"));
+
+  auto it_space = spaces.find(packet.pid);
+  if (it_space == spaces.end()) return;
+
+  Space& space = *it_space->second;
+  // Reply for resent operation arrives twice, the latter is ignored.
+  if (space.atomic_requests.erase(serial) == 0) return;
+  space.atomic_results[serial] = Convert::json2bin(packet.content.at("old"));
+
+  auto it_page = space.pages.find(get_upper_addr(addr));
+  if (it_page != space.pages.end() && it_page->second.type == PT_COPY) {
+    Page& page = it_page->second;
+    const std::string& value = Convert::json2bin(packet.content.at("value"));
+    if (page.size >= get_lower_addr(addr) + value.size()) {
+      page.value.store(get_lower_addr(addr), reinterpret_cast<const uint8_t*>(value.data()),
+                       value.size());
+    }
+  }
+
+  delegate.vmemory_recv_update(*this, get_upper_addr(addr));
+}
+
+/**
+ * Execute atomic read-modify-write operation for value of a page.
+ * @param page Target page.
+ * @param offset Begin of target integer in the page.
+ * @param type Kind of operation.
+ * @param operand Operand of operation.
+ * @param compare Value to compare for AT_CMPXCHG.
+ * @return Value before the operation.
+ */
+std::string VMemory::apply_atomic(Page& page, uint64_t offset, AtomicType type,
+                                  const std::string& operand, const std::string& compare) {
+  uint64_t size = operand.size();
+  if (page.size < offset + size || (type == AT_CMPXCHG && compare.size() != size)) {
+    /// @todo error
+    assert(false);
+    return std::string();
+  }
+
+  uint8_t* ptr = page.value.get() + offset;
+  std::string old(reinterpret_cast<const char*>(ptr), size);
+  const uint8_t* src = reinterpret_cast<const uint8_t*>(operand.data());
+  const uint8_t* cmp = reinterpret_cast<const uint8_t*>(compare.data());
+  switch (size) {
+    case 1: compute_atomic<int8_t>(ptr, type, src, cmp); break;
+    case 2: compute_atomic<int16_t>(ptr, type, src, cmp); break;
+    case 4: compute_atomic<int32_t>(ptr, type, src, cmp); break;
+    case 8: compute_atomic<int64_t>(ptr, type, src, cmp); break;
+    default: {
+      /// @todo error
+      assert(false);
+    } break;
+  }
+  return old;
+}
+
 /**
  * When receive copy command, check and copy value on target address.
  * At last, pass update event to VM throught a delegate.
@@ -99,8 +327,15 @@ void VMemory::recv_command(const CommandPacket& packet) {
  */
 void VMemory::recv_command_copy(const CommandPacket& packet) {
   vaddr_t addr = Convert::json2vaddr(packet.content.at("addr"));
-  const std::string& value = Convert::json2bin(packet.content.at("value"));
-  uint64_t key = Convert::json2int<uint64_t>(packet.content.at("key"));
+  std::string buffer;
+  uint64_t length;
+  const uint8_t* value = json2value(packet.content, buffer, length);
+  uint64_t version = Convert::json2int<uint64_t>(packet.content.at("version"));
+  // Copy of chunks in a large page has offset and whole size of the page.
+  auto it_offset = packet.content.find("offset");
+  bool is_chunk = it_offset != packet.content.end();
+  uint64_t offset = is_chunk ? Convert::json2int<uint64_t>(it_offset->second) : 0;
+  uint64_t size = is_chunk ? Convert::json2int<uint64_t>(packet.content.at("size")) : length;
 
   if (get_upper_addr(addr) != addr) {
     /// @todo error
@@ -116,44 +351,68 @@ void VMemory::recv_command_copy(const CommandPacket& packet) {
   Space& space = *it_space->second;
   auto it_page = space.pages.find(addr);
   if (it_page == space.pages.end()) {
-    if (value.size() == 0) return;
+    if (size == 0) {
+      space.locations.erase(addr);
+      return;
+    }
 
     auto it_ri = space.requiring.find(addr);
     if (it_ri != space.requiring.end()) {
       std::set<nid_t> hint;
       hint.insert(packet.src_nid);
-      space.pages.insert(std::make_pair
-                         (addr, Page(is_program(addr) ? PT_PROGRAM : PT_COPY,
-                                     true, value, hint)));
+      Page& page = space.pages.insert(std::make_pair
+                                      (addr, Page(is_program(addr) ? PT_PROGRAM : PT_COPY,
+                                                  false, hint))).first->second;
+      page.store_copy(value, length, offset, size, is_chunk);
+      page.version = version;
+      if (page.type == PT_COPY) space.copy_bytes += page.size;
+      space.locations.erase(addr);
       space.requiring.erase(it_ri);
-      send_command_copy_reply(packet.src_nid, space, addr, key);
+      send_command_copy_reply(packet.src_nid, space, addr, version);
+      prefetch_pointers(space, addr);
+      evict_copies(space);
 
     } else {
       send_command_unwant(packet.src_nid, packet.pid, addr);
+      set_location(space, addr, packet.src_nid);
     }
 
   } else {
     Page& page = it_page->second;
     assert(page.hint.size() == 1);
-    assert(*page.hint.begin() == packet.src_nid);
 
-    if (page.type != PT_COPY) {
-      return;
+    if (page.type != PT_COPY) return;
 
-    } else if (page.referral_count >= MEMORY_REFERRAL_LIMIT &&
-               space.requiring.find(addr) == space.requiring.end()) {
+    if (*page.hint.begin() != packet.src_nid) {
+      // Master given with warp isn't told to copy nodes, sender of newer copy is the master now.
+      if (version < page.version) return;
+      page.hint.clear();
+      page.hint.insert(packet.src_nid);
+    }
+
+    if (!policy->should_keep_copy(page.stats) &&
+        space.requiring.find(addr) == space.requiring.end() &&
+        space.precopied.find(addr) == space.precopied.end()) {
       send_command_unwant(packet.src_nid, packet.pid, addr);
       space.pages.erase(addr);
-
-    } else if (value.size() != 0) {
-      if (page.size != value.size()) {
-        page.size = value.size();
-        page.value.reset(new uint8_t[page.size]);
+      set_location(space, addr, packet.src_nid);
+
+    } else if (size != 0) {
+      // Whole of page older than this copy was overtaken by newer copy, discard it.
+      if (is_chunk || version >= page.version) {
+        uint64_t old_size = page.size;
+        page.store_copy(value, length, offset, size, is_chunk);
+        page.version = std::max(page.version, version);
+        // Master sent this copy before executing operations not acknowledged yet.
+        for (auto& op : page.updating) apply_op(page, op);
+        if (page.size > old_size) space.copy_bytes += page.size - old_size;
+      }
+      page.stats.record_copy();
+      send_command_copy_reply(packet.src_nid, space, addr, version);
+      if (space.requiring.find(addr) != space.requiring.end()) {
+        space.requiring.erase(addr);
+        prefetch_pointers(space, addr);
       }
-      std::memcpy(page.value.get(), value.data(), page.size);
-      page.flg_update = true;
-      page.referral_count++;
-      send_command_copy_reply(packet.src_nid, space, addr, key);
 
     } else {
       space.pages.erase(addr);
@@ -163,6 +422,7 @@ void VMemory::recv_command_copy(const CommandPacket& packet) {
     if (it_ri != space.requiring.end()) {
       space.requiring.erase(it_ri);
     }
+    evict_copies(space);
   }
 
   delegate.vmemory_recv_update(*this, addr);
@@ -170,11 +430,11 @@ void VMemory::recv_command_copy(const CommandPacket& packet) {
 
 /**
  * When receive copy reply command, check history and send new packet if a page was updated.
- * @param packet Packet command containing target address and key code that was send by a copy command.
+ * @param packet Packet command containing target address and version that was send by a copy command.
  */
 void VMemory::recv_command_copy_reply(const CommandPacket& packet) {
   vaddr_t addr = Convert::json2vaddr(packet.content.at("addr"));
-  uint64_t key = Convert::json2int<uint64_t>(packet.content.at("key"));
+  uint64_t version = Convert::json2int<uint64_t>(packet.content.at("version"));
   assert(addr == get_upper_addr(addr));
 
   auto it_space = spaces.find(packet.pid);
@@ -188,12 +448,14 @@ void VMemory::recv_command_copy_reply(const CommandPacket& packet) {
   auto it_history = page.send_copy_history.find(packet.src_nid);
   if (it_history == page.send_copy_history.end()) return;
 
-  if (it_history->second.key == key) {
+  if (it_history->second.pending_begin != it_history->second.pending_end) {
+    uint64_t begin = it_history->second.pending_begin;
+    uint64_t end = it_history->second.pending_end;
     page.send_copy_history.erase(it_history);
+    send_command_copy(packet.src_nid, space, page, addr, begin, end - begin);
 
-  } else {
+  } else if (version >= it_history->second.version) {
     page.send_copy_history.erase(it_history);
-    send_command_copy(packet.src_nid, space, page, addr);
   }
 }
 
@@ -227,9 +489,7 @@ void VMemory::recv_command_free(const CommandPacket& packet) {
       }
       page.size = 0;
       page.value.reset();
-      for (auto& dst_nid : page.hint) {
-        send_command_copy(dst_nid, space, page, addr);
-      }
+      update_master(space, page, addr);
       space.release_addr(addr);
       space.pages.erase(addr);
     } break;
@@ -252,21 +512,39 @@ void VMemory::recv_command_free(const CommandPacket& packet) {
  * @param packet Command packet containing target address, value, destination node-id, and hint node-id.
  */
 void VMemory::recv_command_give(const CommandPacket& packet) {
-  vaddr_t addr = Convert::json2vaddr(packet.content.at("addr"));
-  const std::string& value = Convert::json2bin(packet.content.at("value"));
-  const nid_t& dst_nid = Convert::json2nid(packet.content.at("dst_nid"));
-  picojson::array js_hint = packet.content.at("hint_nid").get<picojson::array>();
+  recv_give(packet.pid, packet.src_nid, packet.content);
+}
+
+/**
+ * Change master flag of a page by parameter of give, that is received by give command or bundle.
+ * @param name Memory space name.
+ * @param src_nid Node-id gave master flag.
+ * @param content Parameter of give.
+ */
+void VMemory::recv_give(const std::string& name, const nid_t& src_nid,
+                        const picojson::object& content) {
+  vaddr_t addr = Convert::json2vaddr(content.at("addr"));
+  std::string buffer;
+  uint64_t length;
+  // Value is omitted if this node has latest value by pre-copy.
+  bool is_kept = content.find("kept") != content.end();
+  const uint8_t* value = is_kept ? nullptr : json2value(content, buffer, length);
+  auto it_version = content.find("version");
+  uint64_t version = it_version == content.end() ? 1 :
+      Convert::json2int<uint64_t>(it_version->second);
+  const nid_t& dst_nid = Convert::json2nid(content.at("dst_nid"));
+  const picojson::array& js_hint = content.at("hint_nid").get<picojson::array>();
 
   assert(addr == get_upper_addr(addr));
 
-  auto it_space = spaces.find(packet.pid);
+  auto it_space = spaces.find(name);
   if (it_space == spaces.end()) {
     if (dst_nid == my_nid) {
       /// @todo Give master to this node but this node is't binded selected name space.
       assert(false);
 
     } else {
-      send_command_unwant(dst_nid, packet.pid, addr);
+      send_command_unwant(dst_nid, name, addr);
       /// @todo send_unwant and relay packet to dst.
       assert(false);
       return;
@@ -283,40 +561,53 @@ void VMemory::recv_command_give(const CommandPacket& packet) {
         hint.insert(hint_node);
       }
     }
-    if (packet.src_nid != NID::SERVER) {
-      hint.insert(packet.src_nid);
+    if (src_nid != NID::SERVER) {
+      hint.insert(src_nid);
     }
 
     if (it_page == space.pages.end()) {
-      space.pages.insert(std::make_pair(addr, Page(PT_MASTER, true, value, hint)));
+      if (is_kept) {
+        /// @todo error
+        assert(false);
+        return;
+      }
+      Page& page = space.pages.insert(std::make_pair(addr, Page(PT_MASTER, true, hint))).
+          first->second;
+      page.store_copy(value, length, 0, length, false);
+      page.version = version;
+      space.locations.erase(addr);
 
     } else {
       Page& page = it_page->second;
-      assert(page.type == PT_COPY || page.type == PT_PROGRAM);
-      // Skip if page type is program and I have it yet.
-      if (page.type == PT_PROGRAM) return;
+      // Skip if page type is program and I have it yet, or master is given by resent bundle.
+      if (page.type == PT_PROGRAM || page.type == PT_MASTER) return;
 
       page.type = PT_MASTER;
-      page.flg_update = true;
-      if (page.size != value.size()) {
-        page.size = value.size();
-        page.value.reset(new uint8_t[page.size]);
+      if (is_kept) {
+        assert(page.version == version && page.is_readable(0, page.size));
+        page.chunks.clear();
+        page.flg_update = true;
+      } else {
+        page.store_copy(value, length, 0, length, false);
       }
-      std::memcpy(page.value.get(), value.data(), page.size);
+      page.version = std::max(page.version, version);
       page.hint = hint;
-      page.referral_count = 0;
+      // Operations not executed by previous master are relayed to this node.
+      page.updating.clear();
     }
 
     auto it_ri = space.requiring.find(addr);
     if (it_ri != space.requiring.end()) {
       space.requiring.erase(it_ri);
     }
+    space.precopied.erase(addr);
 
     delegate.vmemory_recv_update(*this, addr);
 
   } else {
     if (it_page == space.pages.end()) {
-      send_command_unwant(dst_nid, packet.pid, addr);
+      send_command_unwant(dst_nid, name, addr);
+      set_location(space, addr, dst_nid);
 
     } else {
       Page& page = it_page->second;
@@ -334,53 +625,43 @@ void VMemory::recv_command_give(const CommandPacket& packet) {
  * @param packet Command packet containing target address and node-id that node required a value.
  */
 void VMemory::recv_command_require(const CommandPacket& packet) {
-  vaddr_t addr = Convert::json2vaddr(packet.content.at("addr"));
-  nid_t src_nid = Convert::json2nid(packet.content.at("src_nid"));
-
-  assert(addr == get_upper_addr(addr));
-  if (src_nid == my_nid) return;
-
-  auto it_space = spaces.find(packet.pid);
-  if (it_space == spaces.end()) {
-    if (src_nid != NID::BROADCAST && src_nid != my_nid) {
-      picojson::object param;
-
-      param.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
-      param.insert(std::make_pair("src_nid", Convert::nid2json(src_nid)));
-
-      send_memory_command(packet.pid, NID::BROADCAST, "require", param);
-    }
-    return;
+  std::vector<vaddr_t> addrs;
+  addrs.push_back(Convert::json2vaddr(packet.content.at("addr")));
+  auto it_hop = packet.content.find("hop");
+
+  auto it_offset = packet.content.find("offset");
+  uint64_t offset = 0;
+  uint64_t length = 0;
+  if (it_offset != packet.content.end()) {
+    offset = Convert::json2int<uint64_t>(it_offset->second);
+    length = Convert::json2int<uint64_t>(packet.content.at("length"));
   }
 
-  Space& space = *it_space->second;
-  auto it_page = space.pages.find(addr);
-  if (it_page == space.pages.end()) {
-    if (src_nid != NID::BROADCAST && src_nid != my_nid) {
-      picojson::object param;
-
-      param.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
-      param.insert(std::make_pair("src_nid", Convert::nid2json(src_nid)));
+  auto it_version = packet.content.find("version");
 
-      send_memory_command(packet.pid, NID::BROADCAST, "require", param);
-    }
-    return;
-  }
-
-  Page& page = it_page->second;
-  if (page.type == PT_MASTER) {
-    page.hint.insert(src_nid);
-
-    send_command_copy(src_nid, space, page, addr);
-
-  } else if (page.type == PT_COPY) {
-    picojson::object param;
-
-    param.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
-    param.insert(std::make_pair("src_nid", Convert::nid2json(src_nid)));
+  reply_require(packet.pid, Convert::json2nid(packet.content.at("src_nid")), addrs,
+                packet.dst_nid == NID::BROADCAST,
+                it_hop == packet.content.end() ? 0 :
+                Convert::json2int<unsigned int>(it_hop->second),
+                offset, length,
+                it_version == packet.content.end() ? 0 :
+                Convert::json2int<uint64_t>(it_version->second));
+}
 
-    send_memory_command(packet.pid, *page.hint.begin(), "require", param);
-  }
+/**
+ * When receive require_batch command, treat each address same as require command.
+ * Addresses to relay are bundled by destination node.
+ * @param packet Command packet containing target addresses and node-id that node required values.
+ */
+void VMemory::recv_command_require_batch(const CommandPacket& packet) {
+  auto it_hop = packet.content.find("hop");
+
+  reply_require(packet.pid, Convert::json2nid(packet.content.at("src_nid")),
+                Convert::json2vaddr_vector(packet.content.at("addrs")),
+                packet.dst_nid == NID::BROADCAST,
+                it_hop == packet.content.end() ? 0 :
+                Convert::json2int<unsigned int>(it_hop->second),
+                0, 0, 0);
 }
 
 /**
@@ -428,12 +709,7 @@ void VMemory::recv_command_stand(const CommandPacket& packet) {
 
   Page& page = it_page->second;
   if (page.type == PT_MASTER && page.master_count == 0) {
-    assert(page.flg_update == true);
-    send_command_give(space, page, addr, packet.src_nid);
-
-    page.type = PT_COPY;
-    page.hint.clear();
-    page.hint.insert(packet.src_nid);
+    give_master(space, page, addr, packet.src_nid);
   }
 
   space.requiring.erase(addr);
@@ -465,54 +741,115 @@ void VMemory::recv_command_unwant(const CommandPacket& packet) {
 }
 
 /**
- * When receive update command, check and update master value on target address.
+ * When receive update command, execute memory operation for master value on target address.
  * Relay update command to master node if this node isn't master.
- * Send give command if this node is master of the page and referal count is more than threshold.
- * @param packet Command packet containing target address and value to update.
+ * Reply to the node that began the operation before sending copy having the result,
+ * and send give command if the migration policy decides it.
+ * @param packet Command packet containing target address and memory operation.
  */
 void VMemory::recv_command_update(const CommandPacket& packet) {
   vaddr_t addr = Convert::json2vaddr(packet.content.at("addr"));
-  const std::string& value = Convert::json2bin(packet.content.at("value"));
+  auto it_origin = packet.content.find("origin");
+  const nid_t& origin = it_origin == packet.content.end() ?
+      packet.src_nid : Convert::json2nid(it_origin->second);
+  RemoteOp op;
+  // Meta data doesn't have lower address, so offset is sent separately.
+  auto it_offset = packet.content.find("offset");
+  op.offset = it_offset == packet.content.end() ?
+      get_lower_addr(addr) : Convert::json2int<uint64_t>(it_offset->second);
+  op.c = 0;
+  op.src = 0;
+  auto it_serial = packet.content.find("serial");
+  op.serial = it_serial == packet.content.end() ?
+      0 : Convert::json2int<uint64_t>(it_serial->second);
+  op.time = 0;
+  auto it_op = packet.content.find("op");
+  const std::string& type = it_op == packet.content.end() ?
+      std::string("store") : it_op->second.get<std::string>();
+  if (type == "store") {
+    op.type = RemoteOp::STORE;
+    op.data = Convert::json2bin(packet.content.at("value"));
+    op.length = op.data.size();
+
+  } else if (type == "fill") {
+    op.type = RemoteOp::FILL;
+    op.c = Convert::json2int<uint8_t>(packet.content.at("c"));
+    op.length = Convert::json2int<uint64_t>(packet.content.at("length"));
+
+  } else if (type == "move") {
+    op.type = RemoteOp::MOVE;
+    op.src = Convert::json2int<uint64_t>(packet.content.at("src"));
+    op.length = Convert::json2int<uint64_t>(packet.content.at("length"));
+
+  } else {
+    /// @todo error
+    assert(false);
+    return;
+  }
 
   auto it_space = spaces.find(packet.pid);
   if (it_space == spaces.end()) {
-    /// @todo relay
-    assert(false);
+    // Origin resends it to the master known at that time.
+    Logger::warn(CoreMid::L1011, "update", Convert::vaddr2str(addr).c_str());
     return;
   }
 
   Space& space = *it_space->second;
   auto it_page = space.pages.find(get_upper_addr(addr));
   if (it_page == space.pages.end()) {
-    /// @todo relay
-    assert(false);
+    // Copy kept after giving master was evicted, master is remembered in the directory.
+    nid_t master = get_location(space, get_upper_addr(addr));
+    if (master == NID::BROADCAST) {
+      Logger::warn(CoreMid::L1011, "update", Convert::vaddr2str(addr).c_str());
+    } else {
+      send_command_update(master, space, get_upper_addr(addr), op, origin);
+    }
     return;
   }
 
   Page& page = it_page->second;
   if (page.type == PT_MASTER) {
-    if (page.size < get_lower_addr(addr) + value.size()) {
-      /// @todo error
-      assert(false);
+    std::map<uint64_t, uint64_t>& replies = space.update_replies[origin];
+    auto it_reply = replies.find(op.serial);
+    if (op.serial != 0 && it_reply != replies.end()) {
+      // Operation resent because the reply was lost, it was executed already.
+      send_command_update_reply(origin, space, get_upper_addr(addr), it_reply->second,
+                                op.serial, false);
       return;
     }
-    std::memcpy(page.value.get() + get_lower_addr(addr), value.data(), value.size());
 
-    page.referral_count++;
-    if (page.referral_count >= MEMORY_REFERRAL_LIMIT && page.master_count == 0) {
-      assert(page.flg_update == true);
-      send_command_give(space, page, get_upper_addr(addr), packet.src_nid);
+    if (!apply_op(page, op)) {
+      // Writer's copy has old size, send latest copy and reject the operation so that it stops
+      // resending it.
+      if (origin != my_nid) {
+        send_command_copy(origin, space, page, get_upper_addr(addr), 0, 0);
+        send_command_update_reply(origin, space, get_upper_addr(addr), page.version, op.serial,
+                                  true);
+      }
+      return;
+    }
+    // Copy received before this reply doesn't contain the result.
+    if (origin != my_nid) {
+      send_command_update_reply(origin, space, get_upper_addr(addr), page.version + 1,
+                                op.serial, false);
+      if (op.serial != 0) {
+        replies[op.serial] = page.version + 1;
+        if (replies.size() > VMemoryUpdate::REPLIES) replies.erase(replies.begin());
+      }
+    }
+    update_master(space, page, get_upper_addr(addr), op.offset, op.length);
 
-      page.type = PT_COPY;
-      page.hint.clear();
-      page.hint.insert(packet.src_nid);
+    // Relaying node didn't write the page, count the write for the node began it.
+    page.stats.record_remote_write(origin);
+    if (page.master_count == 0 && origin != my_nid &&
+        policy->should_give_on_write(page.stats, origin)) {
+      give_master(space, page, get_upper_addr(addr), origin);
     }
 
     delegate.vmemory_recv_update(*this, get_upper_addr(addr));
 
   } else if (page.type == PT_COPY) {
-    send_command_update(*page.hint.begin(), space, addr,
-                        reinterpret_cast<const uint8_t*>(value.data()), value.size());
+    send_command_update(*page.hint.begin(), space, get_upper_addr(addr), op, origin);
 
   } else {
     /// @todo error
@@ -520,32 +857,832 @@ void VMemory::recv_command_update(const CommandPacket& packet) {
   }
 }
 
+/**
+ * When receive update reply command, drop the oldest operation not acknowledged yet.
+ * Copies received after this command contain the result of the operation.
+ * @param packet Command packet containing target address and version having the result.
+ */
+void VMemory::recv_command_update_reply(const CommandPacket& packet) {
+  vaddr_t addr = Convert::json2vaddr(packet.content.at("addr"));
+  auto it_serial = packet.content.find("serial");
+  uint64_t serial = it_serial == packet.content.end() ?
+      0 : Convert::json2int<uint64_t>(it_serial->second);
+  assert(addr == get_upper_addr(addr));
+
+  auto it_space = spaces.find(packet.pid);
+  if (it_space == spaces.end()) return;
+
+  Space& space = *it_space->second;
+  auto it_page = space.pages.find(addr);
+  if (it_page == space.pages.end()) return;
+
+  Page& page = it_page->second;
+  if (page.type != PT_COPY || serial == 0) return;
+  // Replies may be reordered or duplicated by resend, match the operation by serial.
+  // Rejected operation is dropped too, master sent latest copy before the reply.
+  for (auto it_op = page.updating.begin(); it_op != page.updating.end(); it_op++) {
+    if (it_op->serial == serial) {
+      page.updating.erase(it_op);
+      break;
+    }
+  }
+  if (page.updating.empty()) space.updating.erase(addr);
+}
+
+/**
+ * Execute memory operation for value of a page.
+ * @param page Target page.
+ * @param op Memory operation.
+ * @return False if the range is out of the page.
+ */
+bool VMemory::apply_op(Page& page, const RemoteOp& op) {
+  if (page.size < op.offset + op.length ||
+      (op.type == RemoteOp::MOVE && page.size < op.src + op.length)) {
+    return false;
+  }
+
+  switch (op.type) {
+    case RemoteOp::STORE: {
+      page.value.store(op.offset, reinterpret_cast<const uint8_t*>(op.data.data()), op.length);
+    } break;
+
+    case RemoteOp::FILL: {
+      if (op.c == 0) {
+        // Zero page is kept without storage.
+        page.value.fill_zero(op.offset, op.length);
+      } else {
+        std::memset(page.value.get() + op.offset, op.c, op.length);
+      }
+    } break;
+
+    case RemoteOp::MOVE: {
+      page.value.store(op.offset, page.value.get_readonly() + op.src, op.length);
+    } break;
+  }
+  return true;
+}
+
 std::unique_ptr<VMemory::Accessor> VMemory::get_accessor(const std::string& name) {
   Space& space = get_space(name);
 
   return std::unique_ptr<VMemory::Accessor>(new Accessor(*this, space));
 }
 
-// Get space by name.
-VMemory::Space& VMemory::get_space(const std::string& name) {
-  if (spaces.find(name) == spaces.end()) {
-    spaces.insert(std::make_pair(name, std::unique_ptr<Space>
-                                 (new Space(name, rnd, *this))));
+// Get space by name.
+VMemory::Space& VMemory::get_space(const std::string& name) {
+  if (spaces.find(name) == spaces.end()) {
+    spaces.insert(std::make_pair(name, std::unique_ptr<Space>
+                                 (new Space(name, rnd, *this))));
+  }
+
+  return *spaces.at(name);
+}
+
+// Switch memory's loading mode.
+void VMemory::set_loading(const std::string& name, bool flg) {
+  Space& space = get_space(name);
+
+  space.is_loading = flg;
+}
+
+// Switch prefetch for pages pointed by arrived page.
+void VMemory::set_prefetch(const std::string& name, bool flg) {
+  Space& space = get_space(name);
+
+  space.is_prefetch = flg;
+}
+
+// Change limit of bytes of copy pages in a memory space.
+void VMemory::set_copy_budget(const std::string& name, uint64_t budget) {
+  Space& space = get_space(name);
+
+  space.copy_budget = budget;
+  evict_copies(space);
+}
+
+// Change limit of bytes of recently accessed pages given with warp of a thread.
+void VMemory::set_warp_budget(const std::string& name, uint64_t budget) {
+  Space& space = get_space(name);
+
+  space.warp_budget = budget;
+}
+
+// Receive pages given by Accessor::give_bundle or copied by Accessor::copy_bundle in another node.
+void VMemory::recv_bundle(const std::string& name, const nid_t& src_nid,
+                          const picojson::array& bundle, vtid_t tid) {
+  Space& space = get_space(name);
+
+  for (auto& js_page : bundle) {
+    const picojson::object& content = js_page.get<picojson::object>();
+    if (content.find("dst_nid") != content.end()) {
+      count_message(space.stats.recv, "give", content);
+      recv_give(name, src_nid, content);
+
+    } else {
+      count_message(space.stats.recv, "copy", content);
+      recv_precopy(space, src_nid, tid, content);
+    }
+  }
+}
+
+// Release pages received by pre-copy of threads, when warp of them arrives.
+void VMemory::release_precopied(const std::string& name, const nid_t& src_nid,
+                                const std::set<vtid_t>& tids) {
+  Space& space = get_space(name);
+
+  auto it_precopied = space.precopied.begin();
+  while (it_precopied != space.precopied.end()) {
+    if (it_precopied->second.src_nid == src_nid &&
+        tids.find(it_precopied->second.tid) != tids.end()) {
+      it_precopied = space.precopied.erase(it_precopied);
+    } else {
+      it_precopied++;
+    }
+  }
+}
+
+// Remove pages not given to a node now from a bundle kept to resend.
+void VMemory::filter_given(const std::string& name, const nid_t& dst_nid,
+                           picojson::array& bundle) {
+  Space& space = get_space(name);
+
+  auto it_give = bundle.begin();
+  while (it_give != bundle.end()) {
+    vaddr_t addr = Convert::json2vaddr(it_give->get<picojson::object>().at("addr"));
+    auto it_page = space.pages.find(addr);
+    if (it_page == space.pages.end() || it_page->second.type != PT_COPY ||
+        *it_page->second.hint.begin() != dst_nid) {
+      it_give = bundle.erase(it_give);
+    } else {
+      it_give++;
+    }
+  }
+}
+
+// Resend commands not replied within MEMORY_REQUIRE_INTERVAL in all spaces.
+void VMemory::resend_commands(uint64_t now) {
+  for (auto& it_space : spaces) {
+    Space& space = *it_space.second;
+
+    auto it_prefetching = space.prefetching.begin();
+    while (it_prefetching != space.prefetching.end()) {
+      if (it_prefetching->second.time + MEMORY_REQUIRE_INTERVAL < now) {
+        space.requiring.erase(it_prefetching->first);
+        it_prefetching = space.prefetching.erase(it_prefetching);
+      } else {
+        it_prefetching++;
+      }
+    }
+
+    // Source may abort pre-copy without telling it, when the thread finishes for example.
+    auto it_precopied = space.precopied.begin();
+    while (it_precopied != space.precopied.end()) {
+      if (it_precopied->second.time + VMemoryWarp::PRECOPY_TIMEOUT < now) {
+        it_precopied = space.precopied.erase(it_precopied);
+      } else {
+        it_precopied++;
+      }
+    }
+
+    auto it_request = space.atomic_requests.begin();
+    while (it_request != space.atomic_requests.end()) {
+      AtomicRequest& request = it_request->second;
+      if (request.time + MEMORY_REQUIRE_INTERVAL >= now) {
+        it_request++;
+        continue;
+      }
+
+      vaddr_t upper = get_upper_addr(request.addr);
+      auto it_page = space.pages.find(upper);
+      if (it_page != space.pages.end() && it_page->second.type == PT_MASTER) {
+        // Master is given to this node before the reply, execute the operation here.
+        Page& page = it_page->second;
+        space.atomic_results[it_request->first] =
+            apply_atomic(page, get_lower_addr(request.addr), request.type, request.operand,
+                         request.compare);
+        update_master(space, page, upper, get_lower_addr(request.addr), request.operand.size());
+        it_request = space.atomic_requests.erase(it_request);
+        delegate.vmemory_recv_update(*this, upper);
+        continue;
+      }
+
+      // Master may be moved since sent, resend to the master known now.
+      nid_t master = it_page == space.pages.end() || it_page->second.type != PT_COPY ?
+          get_location(space, upper) : *it_page->second.hint.begin();
+      send_command_atomic(master, space, request.addr, request.type, request.operand,
+                          request.compare, it_request->first, my_nid);
+      request.time = now;
+      it_request++;
+    }
+
+    auto it_addr = space.updating.begin();
+    while (it_addr != space.updating.end()) {
+      auto it_page = space.pages.find(*it_addr);
+      if (it_page == space.pages.end() || it_page->second.type != PT_COPY ||
+          it_page->second.updating.empty()) {
+        it_addr = space.updating.erase(it_addr);
+        continue;
+      }
+
+      // Master may be moved since sent, resend to the master known now in the same order.
+      Page& page = it_page->second;
+      for (auto& op : page.updating) {
+        if (op.serial == 0 || op.time + MEMORY_REQUIRE_INTERVAL >= now) continue;
+        send_command_update(*page.hint.begin(), space, *it_addr, op, my_nid);
+        op.time = now;
+      }
+      it_addr++;
+    }
+  }
+}
+
+/**
+ * Store a copy of page sent by pre-copy of warp.
+ * Source node is master of the page and has added this node to copy nodes.
+ * The page is kept without eviction until master flag is given with warp.
+ * @param space Target memory space.
+ * @param src_nid Node-id sent copy, it is master of the page.
+ * @param tid Thread-id the copy is sent for.
+ * @param content Parameter of copy.
+ */
+void VMemory::recv_precopy(Space& space, const nid_t& src_nid, vtid_t tid,
+                           const picojson::object& content) {
+  vaddr_t addr = Convert::json2vaddr(content.at("addr"));
+  std::string buffer;
+  uint64_t length;
+  const uint8_t* value = json2value(content, buffer, length);
+  uint64_t version = Convert::json2int<uint64_t>(content.at("version"));
+  assert(addr == get_upper_addr(addr));
+
+  auto it_page = space.pages.find(addr);
+  if (it_page == space.pages.end()) {
+    std::set<nid_t> hint;
+    hint.insert(src_nid);
+    Page& page = space.pages.insert(std::make_pair(addr, Page(PT_COPY, false, hint))).
+        first->second;
+    page.store_copy(value, length, 0, length, false);
+    page.version = version;
+    space.copy_bytes += page.size;
+    space.locations.erase(addr);
+
+  } else {
+    Page& page = it_page->second;
+    if (page.type != PT_COPY) return;
+    if (version >= page.version) {
+      uint64_t old_size = page.size;
+      page.store_copy(value, length, 0, length, false);
+      page.version = version;
+      for (auto& op : page.updating) apply_op(page, op);
+      if (page.size > old_size) space.copy_bytes += page.size - old_size;
+    }
+    page.hint.clear();
+    page.hint.insert(src_nid);
+  }
+
+  PrecopyEntry& entry = space.precopied[addr];
+  entry.src_nid = src_nid;
+  entry.tid = tid;
+  entry.time = Util::get_clock_ms();
+  space.requiring.erase(addr);
+  send_command_copy_reply(src_nid, space, addr, version);
+  delegate.vmemory_recv_update(*this, addr);
+}
+
+// Replace policy to move master flag and copy of pages.
+void VMemory::set_migration_policy(std::unique_ptr<MigrationPolicy> policy_) {
+  assert(policy_);
+  policy = std::move(policy_);
+}
+
+// Get statistics of a memory space.
+picojson::object VMemory::get_stats(const std::string& name) {
+  Space& space = get_space(name);
+  static const char* TYPE_NAMES[] = {"master", "copy", "program"};
+  uint64_t counts[3] = {0, 0, 0};
+  uint64_t sizes[3] = {0, 0, 0};
+  for (auto& it_page : space.pages) {
+    counts[it_page.second.type]++;
+    sizes[it_page.second.type] += it_page.second.size;
+  }
+
+  picojson::object pages;
+  picojson::object bytes;
+  for (int type = PT_MASTER; type <= PT_PROGRAM; type++) {
+    pages.insert(std::make_pair(TYPE_NAMES[type], Convert::int2json(counts[type])));
+    bytes.insert(std::make_pair(TYPE_NAMES[type], Convert::int2json(sizes[type])));
+  }
+
+  picojson::object stats;
+  stats.insert(std::make_pair("pages", picojson::value(pages)));
+  stats.insert(std::make_pair("bytes", picojson::value(bytes)));
+  stats.insert(std::make_pair("access", Convert::int2json(space.stats.access)));
+  stats.insert(std::make_pair("miss", Convert::int2json(space.stats.miss)));
+  for (auto* it : {&space.stats.sent, &space.stats.recv}) {
+    picojson::object messages;
+    for (auto& it_message : *it) {
+      picojson::object message;
+      message.insert(std::make_pair("count", Convert::int2json(it_message.second.count)));
+      message.insert(std::make_pair("bytes", Convert::int2json(it_message.second.bytes)));
+      messages.insert(std::make_pair(it_message.first, picojson::value(message)));
+    }
+    stats.insert(std::make_pair(it == &space.stats.sent ? "sent" : "recv",
+                                picojson::value(messages)));
+  }
+
+  return stats;
+}
+
+// Take snapshot of master and program pages in a memory space.
+std::map<vaddr_t, VMemory::PageImage> VMemory::snapshot(const std::string& name,
+                                                       bool with_copies) {
+  Space& space = get_space(name);
+  std::map<vaddr_t, PageImage> images;
+
+  for (auto& it_page : space.pages) {
+    Page& page = it_page.second;
+    if (page.type == PT_COPY &&
+        (!with_copies || !page.is_readable(0, page.size) || !page.updating.empty())) {
+      continue;
+    }
+    PageImage& image = images[it_page.first];
+    image.type = page.type == PT_COPY ? PT_MASTER : page.type;
+    image.size = page.size;
+    image.version = page.version;
+    if (page.master_count == 0) {
+      image.value = page.value.share();
+    } else {
+      // Storage kept in place by raw pointer must not be shared, it is written without copy.
+      image.value.allocate(page.size);
+      image.value.store(0, page.value.get_readonly(), page.size);
+    }
+  }
+
+  return images;
+}
+
+// Check snapshot of a memory space contains all pages of it.
+bool VMemory::is_snapshot_complete(const std::string& name, bool with_copies) {
+  Space& space = get_space(name);
+  if (!space.locations.empty()) return false;
+
+  for (auto& it_page : space.pages) {
+    Page& page = it_page.second;
+    if (page.type == PT_COPY &&
+        (!with_copies || !page.is_readable(0, page.size) || !page.updating.empty())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Write pages taken by snapshot to a stream as binary image.
+void VMemory::write_image(std::map<vaddr_t, PageImage>& images, std::ostream& os) {
+  write_raw<uint32_t>(os, VMemoryImage::MAGIC);
+  write_raw<uint32_t>(os, VMemoryImage::VERSION);
+
+  for (auto& it_image : images) {
+    PageImage& image = it_image.second;
+    write_raw<vaddr_t>(os, it_image.first);
+    write_raw<uint8_t>(os, image.type);
+    write_raw<uint64_t>(os, image.size);
+    write_raw<uint64_t>(os, image.version);
+
+    // Ranges of non-zero blocks, zero page has no range and storage is not touched.
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (uint64_t offset = 0; offset < image.size; offset += VMemoryImage::BLOCK) {
+      uint64_t length = std::min(VMemoryImage::BLOCK, image.size - offset);
+      if (image.value.is_zero(offset, length)) continue;
+      if (!ranges.empty() && ranges.back().first + ranges.back().second == offset) {
+        ranges.back().second += length;
+      } else {
+        ranges.push_back(std::make_pair(offset, length));
+      }
+    }
+
+    write_raw<uint32_t>(os, static_cast<uint32_t>(ranges.size()));
+    for (auto& range : ranges) {
+      write_raw<uint64_t>(os, range.first);
+      write_raw<uint64_t>(os, range.second);
+      os.write(reinterpret_cast<const char*>(image.value.get_readonly() + range.first),
+               range.second);
+    }
+  }
+  write_raw<vaddr_t>(os, VADDR_NULL);
+}
+
+// Read pages written by write_image into a memory space.
+bool VMemory::read_image(const std::string& name, std::istream& is, bool overwrite) {
+  Space& space = get_space(name);
+  std::map<vaddr_t, Page> pages;
+
+  if (read_raw<uint32_t>(is) != VMemoryImage::MAGIC ||
+      read_raw<uint32_t>(is) != VMemoryImage::VERSION) {
+    throw_error_message(Error::PARSE, "unsupported memory image");
+  }
+
+  std::string buffer;
+  for (vaddr_t addr = read_raw<vaddr_t>(is); addr != VADDR_NULL; addr = read_raw<vaddr_t>(is)) {
+    PageType type = static_cast<PageType>(read_raw<uint8_t>(is));
+    uint64_t size = read_raw<uint64_t>(is);
+    uint64_t version = read_raw<uint64_t>(is);
+    if (type != PT_MASTER && type != PT_PROGRAM) {
+      throw_error_message(Error::PARSE, "broken memory image");
+    }
+
+    pages.erase(addr);
+    Page& page = pages.insert(std::make_pair(addr, Page(type, true, std::set<nid_t>()))).
+        first->second;
+    page.size = size;
+    page.version = version;
+    page.value.allocate(size);
+
+    uint32_t count = read_raw<uint32_t>(is);
+    for (uint32_t i = 0; i < count; i++) {
+      uint64_t offset = read_raw<uint64_t>(is);
+      uint64_t length = read_raw<uint64_t>(is);
+      if (offset + length > size) {
+        throw_error_message(Error::PARSE, "broken memory image");
+      }
+      buffer.resize(length);
+      if (!is.read(&buffer[0], length)) {
+        throw_error_message(Error::PARSE, "broken memory image");
+      }
+      page.value.store(offset, reinterpret_cast<const uint8_t*>(buffer.data()), length);
+    }
+  }
+
+  if (!overwrite) {
+    for (auto& it_page : pages) {
+      if (space.pages.find(it_page.first) != space.pages.end()) return false;
+    }
+  }
+
+  for (auto& it_page : pages) {
+    space.pages.erase(it_page.first);
+    space.pages.insert(std::make_pair(it_page.first, std::move(it_page.second)));
+    space.locations.erase(it_page.first);
+    space.requiring.erase(it_page.first);
+  }
+  return true;
+}
+
+// Print statistics and summary of pages in a memory space.
+void VMemory::print_dump(const std::string& name) {
+#ifndef NDEBUG
+  Space& space = get_space(name);
+  static const char* TYPE_NAMES[] = {"master", "copy", "program"};
+
+  Logger::dbg_raw(CoreMid::L1007, picojson::value(get_stats(name)).serialize());
+  for (auto& it_page : space.pages) {
+    Page& page = it_page.second;
+    Logger::dbg_raw(CoreMid::L1007, "%s %s size=%" PRIu64 " version=%" PRIu64 " hint=%zu%s",
+                    Convert::vaddr2str(it_page.first).c_str(), TYPE_NAMES[page.type],
+                    page.size, page.version, page.hint.size(),
+                    page.flg_update ? "" : " (not readable)");
+  }
+#endif
+}
+
+/**
+ * Scan a page arrived by require and prefetch pages pointed from it.
+ * Any 8byte aligned word that looks like an address in value region is treated as a pointer.
+ * Pages arrived by prefetch are scanned too, until the depth reach to the limit.
+ * Chunked pages are not scanned, those may be partial and are too large to scan.
+ * @param space Target memory space.
+ * @param addr Address of arrived page.
+ */
+void VMemory::prefetch_pointers(Space& space, vaddr_t addr) {
+  unsigned int depth = 0;
+  auto it_prefetching = space.prefetching.find(addr);
+  if (it_prefetching != space.prefetching.end()) {
+    depth = it_prefetching->second.depth;
+    space.prefetching.erase(it_prefetching);
+  }
+
+  vaddr_t region = addr & AddressRegion::MASK;
+  if (!space.is_prefetch || depth >= VMemoryPrefetch::DEPTH ||
+      region < AddressRegion::VALUE_08 || AddressRegion::VALUE_48 < region) {
+    return;
+  }
+
+  Page& page = space.pages.find(addr)->second;
+  if (is_chunked(page.size) || page.value.is_zero(0, page.size)) return;
+
+  std::map<nid_t, std::vector<vaddr_t>> require;
+  uint64_t now = Util::get_clock_ms();
+  unsigned int count = 0;
+  for (uint64_t pos = 0; pos + sizeof(vaddr_t) <= page.size &&
+           count < VMemoryPrefetch::MAX_ADDRS; pos += sizeof(vaddr_t)) {
+    vaddr_t ptr;
+    std::memcpy(&ptr, page.value.get_readonly() + pos, sizeof(vaddr_t));
+    region = ptr & AddressRegion::MASK;
+    if (region < AddressRegion::VALUE_08 || AddressRegion::VALUE_48 < region) continue;
+
+    vaddr_t upper = get_upper_addr(ptr);
+    if (upper == addr || space.requiring.find(upper) != space.requiring.end() ||
+        space.pages.find(upper) != space.pages.end()) continue;
+
+    // Other values like double look like pointer too, prefetch only address having known owner.
+    nid_t location = get_location(space, upper);
+    if (location == NID::BROADCAST) continue;
+
+    space.requiring.insert(upper);
+    PrefetchEntry& entry = space.prefetching[upper];
+    entry.depth = depth + 1;
+    entry.time = now;
+    require[location].push_back(upper);
+    count++;
+  }
+
+  for (auto& it : require) {
+    send_command_require_batch(it.first, space.name, my_nid, it.second, 0, 0, 0, 0);
+  }
+}
+
+/**
+ * Get a node-id to send require command for a page this node doesn't have.
+ * Use the directory at first, next the node assigning addresses from the lease partition,
+ * broad cast if both are unknown.
+ * @param space Target memory space.
+ * @param addr Target address.
+ * @return Node-id or BROADCAST.
+ */
+nid_t VMemory::get_location(Space& space, vaddr_t addr) {
+  auto it_location = space.locations.find(addr);
+  if (it_location != space.locations.end()) {
+    return it_location->second;
+  }
+
+  if (is_leased_region(addr & AddressRegion::MASK)) {
+    auto it_nid = partition_nids.find(get_lease_partition(addr));
+    if (it_nid != partition_nids.end() && it_nid->second != my_nid) {
+      return it_nid->second;
+    }
+  }
+
+  return NID::BROADCAST;
+}
+
+/**
+ * Remember the node assigning addresses from the lease partition of a node.
+ * The node is master of addresses at first, or knows the next master by a copy or the directory.
+ * Partition shared by nodes by collision of hash is forgotten, commands for it are broadcast.
+ * This node assigns addresses by reserve command after its partition is found to be shared.
+ * @param nid Node-id of the packet source.
+ */
+void VMemory::learn_partition(const nid_t& nid) {
+  if (nid == NID::NONE || nid == NID::THIS || nid == NID::BROADCAST || nid == NID::SERVER ||
+      nid == my_nid) {
+    return;
+  }
+
+  vaddr_t partition = get_lease_partition(nid);
+  if (partition == get_lease_partition(my_nid)) {
+    if (!is_lease_shared) {
+      Logger::warn(CoreMid::L1012, nid.c_str());
+      is_lease_shared = true;
+    }
+    return;
+  }
+  if (shared_partitions.find(partition) != shared_partitions.end()) return;
+
+  auto it_nid = partition_nids.find(partition);
+  if (it_nid == partition_nids.end()) {
+    partition_nids.insert(std::make_pair(partition, nid));
+
+  } else if (it_nid->second != nid) {
+    shared_partitions.insert(partition);
+    partition_nids.erase(it_nid);
+  }
+}
+
+/**
+ * Reply copy command for pages this node is master, and relay require command for other pages.
+ * Master flag is given instead of copy if the migration policy decides it.
+ * Copy is not sent if the node has the latest version, it will be pushed when master changes it.
+ * Only master replies for broad casted command, because every nodes receive it.
+ * Directed command is relayed to master node if this node has a copy, or to a node found in
+ * the directory, and broad casted at last.
+ * @param name Target memory name.
+ * @param src_nid Node-id that required values.
+ * @param addrs Target addresses.
+ * @param is_broadcast True if the command was broad casted.
+ * @param hop Count of relay the command was passed.
+ * @param offset Begin of range to require for large page.
+ * @param length Length of range to require, whole of page if 0.
+ * @param version Version of value the node has, 0 if the node doesn't have value.
+ */
+void VMemory::reply_require(const std::string& name, const nid_t& src_nid,
+                            const std::vector<vaddr_t>& addrs, bool is_broadcast,
+                            unsigned int hop, uint64_t offset, uint64_t length,
+                            uint64_t version) {
+  if (src_nid == my_nid) return;
+
+  auto it_space = spaces.find(name);
+  std::map<nid_t, std::vector<vaddr_t>> relay;
+  for (auto addr : addrs) {
+    assert(addr == get_upper_addr(addr));
+
+    if (it_space == spaces.end()) {
+      if (!is_broadcast) {
+        relay[NID::BROADCAST].push_back(addr);
+      }
+      continue;
+    }
+
+    Space& space = *it_space->second;
+    auto it_page = space.pages.find(addr);
+    if (it_page == space.pages.end()) {
+      if (!is_broadcast) {
+        nid_t location = NID::BROADCAST;
+        if (hop < VMemoryDirectory::MAX_HOP) {
+          location = get_location(space, addr);
+        }
+        if (location == src_nid) {
+          location = NID::BROADCAST;
+        }
+        relay[location].push_back(addr);
+      }
+      continue;
+    }
+
+    Page& page = it_page->second;
+    if (page.type == PT_MASTER) {
+      page.hint.insert(src_nid);
+
+      // Give command carries value too, so copy is not needed in that case.
+      page.stats.record_remote_read(src_nid);
+      if (page.master_count == 0 && policy->should_give_on_read(page.stats, src_nid)) {
+        give_master(space, page, addr, src_nid);
+      } else if (page.version > version) {
+        send_command_copy(src_nid, space, page, addr, offset, length);
+      }
+
+    } else if (page.type == PT_COPY && !is_broadcast) {
+      relay[*page.hint.begin()].push_back(addr);
+    }
+  }
+
+  for (auto& it : relay) {
+    send_command_require_batch(it.first, name, src_nid, it.second,
+                               it.first == NID::BROADCAST ? 0 : hop + 1, offset, length, version);
+  }
+}
+
+/**
+ * Give master flag of a page to another node and become copy of it.
+ * @param space Target memory space.
+ * @param page Target page, this node should be master of it and not locked.
+ * @param addr Target address.
+ * @param dst_nid Node-id to give master flag.
+ * @param bundle Array to append parameter of give to send it by another command,
+ * nullptr to send give command.
+ * @param with_value False if value is omitted from bundle because target node has it.
+ */
+void VMemory::give_master(Space& space, Page& page, vaddr_t addr, const nid_t& dst_nid,
+                          picojson::array* bundle, bool with_value) {
+  assert(page.type == PT_MASTER && page.master_count == 0);
+  assert(page.flg_update == true);
+  if (bundle == nullptr) {
+    send_command_give(space, page, addr, dst_nid);
+
+  } else {
+    picojson::object param = give2json(page, addr, dst_nid, with_value);
+    count_message(space.stats.sent, "give", param);
+    bundle->push_back(picojson::value(param));
+  }
+
+  page.type = PT_COPY;
+  page.hint.clear();
+  page.hint.insert(dst_nid);
+  page.stats.record_give();
+  space.copy_bytes += page.size;
+}
+
+/**
+ * Evict copy pages by CLOCK if bytes of copy pages are over the budget.
+ * Bytes are recounted at first because the counter isn't decreased by every path.
+ * Evicted page is unwanted to master node so that master stops sending copy to this node.
+ * Pages accessed since last scan, pages requiring, and pages received by pre-copy are skipped.
+ * Pages this node gave master of recently are skipped too, other nodes relay commands by them.
+ * @param space Target memory space.
+ */
+void VMemory::evict_copies(Space& space) {
+  if (space.copy_bytes <= space.copy_budget) return;
+
+  space.copy_bytes = 0;
+  for (auto& it_page : space.pages) {
+    if (it_page.second.type == PT_COPY) space.copy_bytes += it_page.second.size;
+  }
+  if (space.copy_bytes <= space.copy_budget) return;
+
+  uint64_t target = space.copy_budget - space.copy_budget / VMemoryCopyCache::LOW_WATER_DIVISOR;
+  // Two rounds are enough to clear all reference bits and evict.
+  size_t steps = space.pages.size() * 2 + 1;
+  auto it_page = space.pages.find_from(space.clock_hand);
+  while (space.copy_bytes > target && steps-- != 0) {
+    if (it_page == space.pages.end()) {
+      it_page = space.pages.begin();
+      if (it_page == space.pages.end()) break;
+    }
+
+    vaddr_t addr = it_page->first;
+    Page& page = it_page->second;
+    if (page.type != PT_COPY || space.requiring.find(addr) != space.requiring.end() ||
+        !page.updating.empty() || space.precopied.find(addr) != space.precopied.end() ||
+        page.stats.gives != 0) {
+      ++it_page;
+
+    } else if (page.stats.referenced) {
+      page.stats.referenced = false;
+      ++it_page;
+
+    } else {
+      nid_t master = *page.hint.begin();
+      space.copy_bytes -= page.size;
+      it_page = space.pages.erase(it_page);
+      send_command_unwant(master, space.name, addr);
+      set_location(space, addr, master);
+    }
+  }
+  space.clock_hand = it_page.get_position();
+}
+
+/**
+ * Remember master node of a page this node doesn't have.
+ * The oldest entry isn't tracked, an arbitrary entry is dropped when the directory is full.
+ * @param space Target memory space.
+ * @param addr Target address.
+ * @param nid Node-id of master node.
+ */
+void VMemory::set_location(Space& space, vaddr_t addr, const nid_t& nid) {
+  auto it_location = space.locations.find(addr);
+  if (nid == my_nid || nid == NID::SERVER) {
+    if (it_location != space.locations.end()) {
+      space.locations.erase(it_location);
+    }
+
+  } else if (it_location != space.locations.end()) {
+    it_location->second = nid;
+
+  } else {
+    if (space.locations.size() >= VMemoryDirectory::MAX_ENTRIES) {
+      space.locations.erase(space.locations.begin());
+    }
+    space.locations.insert(std::make_pair(addr, nid));
+  }
+}
+
+// Insert value of a range into parameter of command.
+void VMemory::value2json(picojson::object& param, PageBuffer& value,
+                         uint64_t offset, uint64_t length) {
+  if (value.is_zero(offset, length)) {
+    param.insert(std::make_pair("zero", Convert::int2json(length)));
+  } else {
+    param.insert(std::make_pair("value", Convert::bin2json(value.get_readonly() + offset, length)));
   }
+}
 
-  return *spaces.at(name);
+/**
+ * Count a command to statistics.
+ * Bytes are counted for page value carried by "value" only.
+ * @param stats Statistics of sent or received commands.
+ * @param command Command name.
+ * @param content Parameter of command.
+ */
+void VMemory::count_message(std::map<std::string, MessageStats>& stats,
+                            const std::string& command, const picojson::object& content) {
+  MessageStats& message = stats[command];
+  message.count++;
+  auto it_value = content.find("value");
+  if (it_value != content.end() && it_value->second.is<std::string>()) {
+    message.bytes += it_value->second.get<std::string>().size() / 2;
+  }
 }
 
-// Switch memory's loading mode.
-void VMemory::set_loading(const std::string& name, bool flg) {
-  Space& space = get_space(name);
+/**
+ * Get value from parameter of command, "zero" is accepted instead of "value" for zero range.
+ * @param content Parameter of command.
+ * @param buffer Buffer to store decoded value.
+ * @param length Length of value.
+ * @return Pointer to value, or nullptr if the value is zero.
+ */
+const uint8_t* VMemory::json2value(const picojson::object& content, std::string& buffer,
+                                   uint64_t& length) {
+  auto it_zero = content.find("zero");
+  if (it_zero != content.end()) {
+    length = Convert::json2int<uint64_t>(it_zero->second);
+    return nullptr;
+  }
 
-  space.is_loading = flg;
+  buffer = Convert::json2bin(content.at("value"));
+  length = buffer.size();
+  return reinterpret_cast<const uint8_t*>(buffer.data());
 }
 
 /**
  * Send selected command to MEMORY module in another node.
- * @param name Not used.
+ * @param name Memory space name, used to count statistics.
  * @param dst_nid Destination node-id, BROADCAST, or NONE if not resolved yet.
  * @param command Command string.
  * @param param Parameter for command.
@@ -553,61 +1690,154 @@ void VMemory::set_loading(const std::string& name, bool flg) {
 void VMemory::send_memory_command(const std::string& name, const nid_t& dst_nid,
                                   const std::string& command, picojson::object& param) {
   assert(dst_nid != my_nid);
+  auto it_space = spaces.find(name);
+  if (it_space != spaces.end()) {
+    count_message(it_space->second->stats.sent, command, param);
+  }
 
   delegate.vmemory_send_command(*this, dst_nid, Module::MEMORY, command, param);
 }
 
+/**
+ * Increase version of a master page changed and send copy of it to nodes having copy.
+ * @param space Target memory space.
+ * @param page Target page changed.
+ * @param addr Target address.
+ * @param offset Begin of range changed.
+ * @param length Length of range changed, whole of page if 0.
+ */
+void VMemory::update_master(Space& space, Page& page, vaddr_t addr,
+                            uint64_t offset, uint64_t length) {
+  assert(page.type == PT_MASTER);
+  page.version++;
+  for (auto& it_hint : page.hint) {
+    send_command_copy(it_hint, space, page, addr, offset, length);
+  }
+}
+
+/**
+ * Send atomic command to execute atomic operation in master node.
+ * @param dst_nid Destination node-id.
+ * @param space Target memory space.
+ * @param addr Target address.
+ * @param type Kind of operation.
+ * @param operand Operand of operation.
+ * @param compare Value to compare for AT_CMPXCHG, empty for other operation.
+ * @param serial Serial number of operation given by the node that began it.
+ * @param origin Node-id of the node that began the operation.
+ */
+void VMemory::send_command_atomic(const nid_t& dst_nid, Space& space, vaddr_t addr,
+                                  AtomicType type, const std::string& operand,
+                                  const std::string& compare, uint64_t serial,
+                                  const nid_t& origin) {
+  picojson::object param;
+  param.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
+  param.insert(std::make_pair("op", Convert::int2json<int>(type)));
+  param.insert(std::make_pair("value", Convert::bin2json(
+      reinterpret_cast<const uint8_t*>(operand.data()), operand.size())));
+  if (type == AT_CMPXCHG) {
+    param.insert(std::make_pair("compare", Convert::bin2json(
+        reinterpret_cast<const uint8_t*>(compare.data()), compare.size())));
+  }
+  param.insert(std::make_pair("serial", Convert::int2json(serial)));
+  if (origin != my_nid) {
+    param.insert(std::make_pair("origin", Convert::nid2json(origin)));
+  }
+  send_memory_command(space.name, dst_nid, "atomic", param);
+}
+
+/**
+ * Send copy command for update whole of page value in another copy node.
+ * @param dst_nid Destination node-id.
+ * @param space Target memory space.
+ * @param page Target page having value.
+ * @param addr Target address to copy.
+ */
+void VMemory::send_command_copy(const nid_t& dst_nid, Space& space, Page& page, vaddr_t addr) {
+  send_command_copy(dst_nid, space, page, addr, 0, 0);
+}
+
 /**
  * Send copy command for update page value in another copy node.
  * This command is used to copy value from master to copy node.
+ * Only chunks in the range are sent for large page, whole of page is sent for other page.
  * Inhibit command if responce (for previous copy command) was not received and
- * didn't spend interval time yet.
- * Update key code and timestamp if command was send.
+ * didn't spend interval time yet, inhibited range is sent when the responce is received.
+ * Update version and timestamp in the history if command was send.
  * @param dst_nid Destination node-id.
  * @param space Target memory space.
  * @param page Target page having value.
  * @param addr Target address to copy.
+ * @param offset Begin of range changed.
+ * @param length Length of range changed, whole of page if 0.
  */
-void VMemory::send_command_copy(const nid_t& dst_nid, Space& space, Page& page, vaddr_t addr) {
+void VMemory::send_command_copy(const nid_t& dst_nid, Space& space, Page& page, vaddr_t addr,
+                                uint64_t offset, uint64_t length) {
   assert(page.type != PT_COPY);
   assert(dst_nid != my_nid);
   assert(get_upper_addr(addr) == addr);
-  std::time_t now = time(nullptr);
-  uint64_t key = space.rnd();
+  uint64_t now = Util::get_clock_ms();
   auto history = page.send_copy_history.find(dst_nid);
 
+  uint64_t begin = 0;
+  uint64_t end = page.size;
+  if (is_chunked(page.size) && length != 0) {
+    begin = offset / VMemoryChunk::SIZE * VMemoryChunk::SIZE;
+    end = std::min(page.size, (offset + length + VMemoryChunk::SIZE - 1) /
+                   VMemoryChunk::SIZE * VMemoryChunk::SIZE);
+  }
+
   if (history == page.send_copy_history.end() ||
       history->second.time + MEMORY_REQUIRE_INTERVAL < now) {
+    if (history != page.send_copy_history.end() &&
+        history->second.pending_begin != history->second.pending_end) {
+      begin = std::min(begin, history->second.pending_begin);
+      end = std::min(page.size, std::max(end, history->second.pending_end));
+      history->second.pending_begin = history->second.pending_end = 0;
+    }
+
     picojson::object param;
     param.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
-    param.insert(std::make_pair("value", Convert::bin2json(page.value.get(), page.size)));
-    param.insert(std::make_pair("key", Convert::int2json(key)));
+    value2json(param, page.value, begin, end - begin);
+    param.insert(std::make_pair("version", Convert::int2json(page.version)));
+    if (is_chunked(page.size)) {
+      param.insert(std::make_pair("offset", Convert::int2json(begin)));
+      param.insert(std::make_pair("size", Convert::int2json(page.size)));
+    }
     send_memory_command(space.name, dst_nid, "copy", param);
 
     if (history != page.send_copy_history.end()) {
+      history->second.version = page.version;
       history->second.time = now;
     }
+
+  } else if (history->second.pending_begin == history->second.pending_end) {
+    history->second.pending_begin = begin;
+    history->second.pending_end = end;
+
+  } else {
+    history->second.pending_begin = std::min(begin, history->second.pending_begin);
+    history->second.pending_end = std::max(end, history->second.pending_end);
   }
 
   if (history == page.send_copy_history.end()) {
     SendCopyHistory new_history;
-    new_history.key  = key;
+    new_history.version = page.version;
     new_history.time = now;
+    new_history.pending_begin = 0;
+    new_history.pending_end = 0;
     page.send_copy_history.insert(std::make_pair(dst_nid, new_history));
-
-  } else {
-    history->second.key = key;
   }
 }
 
 void VMemory::send_command_copy_reply(const nid_t& dst_nid, Space& space,
-                                      vaddr_t addr, uint64_t key) {
+                                      vaddr_t addr, uint64_t version) {
   assert(dst_nid != my_nid);
   assert(get_upper_addr(addr) == addr);
 
   picojson::object param;
   param.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
-  param.insert(std::make_pair("key", Convert::int2json(key)));
+  param.insert(std::make_pair("version", Convert::int2json(version)));
 
   send_memory_command(space.name, dst_nid, "copy_reply", param);
 }
@@ -634,20 +1864,40 @@ void VMemory::send_command_free(const nid_t& dst_nid, Space& space, vaddr_t addr
  * @param dst_nid Node-id target of give master flag.
  */
 void VMemory::send_command_give(Space& space, Page& page, vaddr_t addr, const nid_t& dst_nid) {
+  picojson::object param = give2json(page, addr, dst_nid, true);
+
+  send_memory_command(space.name, NID::BROADCAST, "give", param);
+}
+
+/**
+ * Make parameter of give for giving master flag of page.
+ * @param page Target page having value.
+ * @param addr Target address to give master flag.
+ * @param dst_nid Node-id target of give master flag.
+ * @param with_value False if target node has latest value, "kept" is sent instead of value.
+ * @return Parameter of give.
+ */
+picojson::object VMemory::give2json(Page& page, vaddr_t addr, const nid_t& dst_nid,
+                                    bool with_value) {
   assert(page.type == PT_MASTER && page.master_count == 0);
   assert(addr == get_upper_addr(addr));
   picojson::object param;
   picojson::array hint;
 
   param.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
-  param.insert(std::make_pair("value", Convert::bin2json(page.value.get(), page.size)));
+  if (with_value) {
+    value2json(param, page.value, 0, page.size);
+  } else {
+    param.insert(std::make_pair("kept", picojson::value(true)));
+  }
+  param.insert(std::make_pair("version", Convert::int2json(page.version)));
   param.insert(std::make_pair("dst_nid", Convert::nid2json(dst_nid)));
   for (auto& h : page.hint) {
     hint.push_back(Convert::nid2json(h));
   }
   param.insert(std::make_pair("hint_nid", picojson::value(hint)));
 
-  send_memory_command(space.name, NID::BROADCAST, "give", param);
+  return param;
 }
 
 /**
@@ -672,18 +1922,70 @@ void VMemory::send_command_release(Space& space, std::set<vaddr_t> addrs) {
  * @param dst_nid Destination node-id.
  * @param space Target memory space.
  * @param addr Target address to get value.
+ * @param offset Begin of range to get value for large page.
+ * @param length Length of range to get value, whole of page if 0.
+ * @param version Version of value this node has, to get newer value than it, 0 if not have.
  */
-void VMemory::send_command_require(const nid_t& dst_nid, Space& space, vaddr_t addr) {
+void VMemory::send_command_require(const nid_t& dst_nid, Space& space, vaddr_t addr,
+                                   uint64_t offset, uint64_t length, uint64_t version) {
   assert(get_upper_addr(addr) == addr);
   space.requiring.insert(addr);
+  // Required by thread now, it isn't dropped as prefetch.
+  space.prefetching.erase(addr);
   picojson::object param;
 
   param.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
   param.insert(std::make_pair("src_nid", Convert::nid2json(my_nid)));
+  if (length != 0) {
+    param.insert(std::make_pair("offset", Convert::int2json(offset)));
+    param.insert(std::make_pair("length", Convert::int2json(length)));
+  }
+  if (version != 0) {
+    param.insert(std::make_pair("version", Convert::int2json(version)));
+  }
 
   send_memory_command(space.name, dst_nid, "require", param);
 }
 
+/**
+ * Send require command for some addresses.
+ * Use require_batch command if there are some addresses, otherwise use require command.
+ * @param dst_nid Destination node-id.
+ * @param name Target memory name.
+ * @param src_nid Node-id that required values.
+ * @param addrs Target addresses to get value.
+ * @param hop Count of relay the command was passed.
+ * @param offset Begin of range to get value for large page, used for single address only.
+ * @param length Length of range to get value, whole of page if 0.
+ * @param version Version of value the node has, used for single address only.
+ */
+void VMemory::send_command_require_batch(const nid_t& dst_nid, const std::string& name,
+                                         const nid_t& src_nid,
+                                         const std::vector<vaddr_t>& addrs,
+                                         unsigned int hop, uint64_t offset, uint64_t length,
+                                         uint64_t version) {
+  assert(addrs.size() != 0);
+  picojson::object param;
+
+  param.insert(std::make_pair("src_nid", Convert::nid2json(src_nid)));
+  param.insert(std::make_pair("hop", Convert::int2json(hop)));
+  if (addrs.size() == 1) {
+    param.insert(std::make_pair("addr", Convert::vaddr2json(addrs.front())));
+    if (length != 0) {
+      param.insert(std::make_pair("offset", Convert::int2json(offset)));
+      param.insert(std::make_pair("length", Convert::int2json(length)));
+    }
+    if (version != 0) {
+      param.insert(std::make_pair("version", Convert::int2json(version)));
+    }
+    send_memory_command(name, dst_nid, "require", param);
+
+  } else {
+    param.insert(std::make_pair("addrs", Convert::vaddr_vector2json(addrs)));
+    send_memory_command(name, dst_nid, "require_batch", param);
+  }
+}
+
 /**
  * Send reserve command for reserving address to allocate memory in this node.
  * @param space Target memory space.
@@ -731,25 +2033,97 @@ void VMemory::send_command_unwant(const nid_t& dst_nid, const std::string name,
 }
 
 /**
- * Send update command for update page value in master node.
+ * Send update command to execute memory operation in master node.
  * @param dst_nid Destination node-id.
  * @param space Target memory space.
- * @param addr Target address to update.
- * @param data Pointer of storeing value to update.
- * @param size Size of data to update.
+ * @param addr Upper address of target page.
+ * @param op Memory operation.
+ * @param origin Node-id of the node that began the operation.
  */
 void VMemory::send_command_update(const nid_t& dst_nid, Space& space, vaddr_t addr,
-                                  const uint8_t* data, uint64_t size) {
+                                  const RemoteOp& op, const nid_t& origin) {
   picojson::object param;
-  param.insert(std::make_pair("value", Convert::bin2json(data, size)));
   param.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
+  param.insert(std::make_pair("offset", Convert::int2json(op.offset)));
+  switch (op.type) {
+    case RemoteOp::STORE: {
+      param.insert(std::make_pair("op", picojson::value("store")));
+      param.insert(std::make_pair("value", Convert::bin2json(
+          reinterpret_cast<const uint8_t*>(op.data.data()), op.length)));
+    } break;
+
+    case RemoteOp::FILL: {
+      param.insert(std::make_pair("op", picojson::value("fill")));
+      param.insert(std::make_pair("c", Convert::int2json(op.c)));
+      param.insert(std::make_pair("length", Convert::int2json(op.length)));
+    } break;
+
+    case RemoteOp::MOVE: {
+      param.insert(std::make_pair("op", picojson::value("move")));
+      param.insert(std::make_pair("src", Convert::int2json(op.src)));
+      param.insert(std::make_pair("length", Convert::int2json(op.length)));
+    } break;
+  }
+  if (origin != my_nid) {
+    param.insert(std::make_pair("origin", Convert::nid2json(origin)));
+  }
+  if (op.serial != 0) {
+    param.insert(std::make_pair("serial", Convert::int2json(op.serial)));
+  }
   send_memory_command(space.name, dst_nid, "update", param);
 }
 
+/**
+ * Send update reply command to acknowledge memory operation.
+ * @param dst_nid Destination node-id, the node that began the operation.
+ * @param space Target memory space.
+ * @param addr Upper address of target page.
+ * @param version Version of page value having the result of the operation.
+ * @param serial Serial number of the operation, 0 if the origin doesn't wait for reply.
+ * @param is_rejected True if the operation isn't executed because the range is out of the page.
+ */
+void VMemory::send_command_update_reply(const nid_t& dst_nid, Space& space, vaddr_t addr,
+                                        uint64_t version, uint64_t serial, bool is_rejected) {
+  picojson::object param;
+  param.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
+  param.insert(std::make_pair("version", Convert::int2json(version)));
+  if (serial != 0) {
+    param.insert(std::make_pair("serial", Convert::int2json(serial)));
+  }
+  if (is_rejected) {
+    param.insert(std::make_pair("rejected", picojson::value(true)));
+  }
+  send_memory_command(space.name, dst_nid, "update_reply", param);
+}
+
+/**
+ * Write to a copy page by memory operation executed in master node.
+ * The operation is applied to this copy too, so the page can be read without waiting for master.
+ * @param space Target memory space.
+ * @param page Target copy page.
+ * @param addr Upper address of target page.
+ * @param op Memory operation.
+ */
+void VMemory::write_remote(Space& space, Page& page, vaddr_t addr, RemoteOp&& op) {
+  assert(page.type == PT_COPY && page.hint.size() == 1);
+  op.serial = ++space.update_serial;
+  op.time = Util::get_clock_ms();
+  send_command_update(*page.hint.begin(), space, addr, op, my_nid);
+  if (!apply_op(page, op)) {
+    // Size of this copy is old, wait for copy from master.
+    page.set_readable(0, 0, false);
+  }
+  // Kept to resend until master acknowledges it, and applied again over received copies.
+  page.updating.push_back(std::move(op));
+  space.updating.insert(addr);
+}
+
 // Constructor with memory space.
 VMemory::Accessor::Accessor(VMemory& vmemory_, Space& space_) :
     vmemory(vmemory_),
-    space(space_) {
+    space(space_),
+    atomic_waiting(0) {
+  flush_cache();
 }
 
 // Get master node-id for target address.
@@ -831,7 +2205,13 @@ std::string VMemory::Accessor::get_meta_area(vaddr_t addr) {
   assert((AddressRegion::MASK & addr) == AddressRegion::META);
   Page& page = get_page(addr, true);
 
-  return std::string(reinterpret_cast<char*>(page.value.get()), page.size);
+  return std::string(reinterpret_cast<const char*>(page.value.get_readonly()), page.size);
+}
+
+// Get version of meta data.
+uint64_t VMemory::Accessor::get_meta_version(vaddr_t addr) {
+  assert((AddressRegion::MASK & addr) == AddressRegion::META);
+  return get_page(addr, true).version;
 }
 
 // Change meta data.
@@ -840,25 +2220,51 @@ void VMemory::Accessor::update_meta_area(vaddr_t addr, const std::string& data)
   Page& page = get_page(addr, true);
 
   if (page.size == data.size() &&
-      std::memcmp(page.value.get(), data.data(), page.size) == 0) return;
+      std::memcmp(page.value.get_readonly(), data.data(), page.size) == 0) return;
 
   switch (page.type) {
     case PT_MASTER: {
       if (page.size != data.size()) {
         page.size = data.size();
-        page.value.reset(new uint8_t[page.size]);
+        page.value.allocate(page.size);
       }
       std::memcpy(page.value.get(), data.data(), page.size);
-      for (auto& it_hint : page.hint) {
-        vmemory.send_command_copy(it_hint, space, page, addr);
-      }
+      vmemory.update_master(space, page, addr);
     } break;
 
     case PT_COPY: {
       assert(page.hint.size() == 1);
-      page.flg_update = false;
+      page.set_readable(0, 0, false);
       vmemory.send_command_update(*page.hint.begin(), space, addr,
-                                  reinterpret_cast<const uint8_t*>(data.data()), data.size());
+                                  {RemoteOp::STORE, 0, data.size(), data, 0, 0, 0, 0},
+                                  vmemory.my_nid);
+    } break;
+
+    default: {
+      /// @todo:error
+      assert(false);
+    } break;
+  }
+}
+
+// Change a range of meta data without changing the size.
+void VMemory::Accessor::update_meta_area(vaddr_t addr, uint64_t offset, const uint8_t* data,
+                                         uint64_t length) {
+  assert((AddressRegion::MASK & addr) == AddressRegion::META);
+  Page& page = get_page(addr, false);
+
+  switch (page.type) {
+    case PT_MASTER: {
+      assert(page.size >= offset + length);
+      page.value.store(offset, data, length);
+      vmemory.update_master(space, page, addr, offset, length);
+    } break;
+
+    case PT_COPY: {
+      vmemory.write_remote(space, page, addr,
+                           {RemoteOp::STORE, offset, length,
+                            std::string(reinterpret_cast<const char*>(data), length),
+                            0, 0, 0, 0});
     } break;
 
     default: {
@@ -877,7 +2283,7 @@ vaddr_t VMemory::Accessor::alloc(uint64_t size) {
   Page& page = space.pages.insert
                (std::make_pair(addr, Page(PT_MASTER, true, std::set<nid_t>()))).first->second;
   page.size = size;
-  page.value.reset(new uint8_t[size]);
+  page.value.allocate(size);
 
   return addr;
 }
@@ -897,9 +2303,7 @@ void VMemory::Accessor::free(vaddr_t addr) {
       assert(page.master_count == 0 && raw_writable.find(addr) == raw_writable.end());
       page.size = 0;
       page.value.reset();
-      for (auto& dst_nid : page.hint) {
-        vmemory.send_command_copy(dst_nid, space, page, addr);
-      }
+      vmemory.update_master(space, page, addr);
       space.release_addr(addr);
       space.pages.erase(addr);
     } break;
@@ -931,20 +2335,10 @@ vaddr_t VMemory::Accessor::realloc(vaddr_t addr, uint64_t size) {
       AddressRegion::Type old_type = static_cast<AddressRegion::Type>(addr & AddressRegion::MASK);
       AddressRegion::Type new_type = get_addr_type(size);
       if (old_type == new_type) {
-        std::unique_ptr<uint8_t[]> tmp(new uint8_t[size]);
-        if (page.size < size) {
-          std::memcpy(tmp.get(), page.value.get(), page.size);
-          std::memset(tmp.get() + page.size, 0, size - page.size);
-
-        } else {
-          std::memcpy(tmp.get(), page.value.get(), size);
-        }
+        page.value.resize(size);
         page.size = size;
-        page.value.swap(tmp);
 
-        for (auto& to : page.hint) {
-          vmemory.send_command_copy(to, space, page, addr);
-        }
+        vmemory.update_master(space, page, addr);
         return addr;
 
       } else {
@@ -953,14 +2347,9 @@ vaddr_t VMemory::Accessor::realloc(vaddr_t addr, uint64_t size) {
         Page& new_page =
             space.pages.insert(std::make_pair(new_addr, Page(PT_MASTER, true, page.hint))).
             first->second;
-        new_page.value.reset(new uint8_t[size]);
-        if (page.size < size) {
-          std::memcpy(new_page.value.get(), page.value.get(), page.size);
-          std::memset(new_page.value.get() + page.size, 0, size - page.size);
-
-        } else {
-          std::memcpy(new_page.value.get(), page.value.get(), size);
-        }
+        // Old page is freed soon, so take over the storage instead of copying it.
+        new_page.value = std::move(page.value);
+        new_page.value.resize(size);
         new_page.size = size;
 
         this->free(addr);
@@ -1008,7 +2397,7 @@ void VMemory::Accessor::set_program_area(vaddr_t addr, const std::string& data)
     Page& page = it_page->second;
     assert(page.size == 0);
     page.size = data.size();
-    page.value.reset(new uint8_t[page.size]);
+    page.value.allocate(page.size);
     std::memcpy(page.value.get(), data.data(), page.size);
   }
 }
@@ -1017,28 +2406,67 @@ void VMemory::Accessor::set_program_area(vaddr_t addr, const std::string& data)
 std::string VMemory::Accessor::get_program_area(vaddr_t addr) {
   Page& page = get_page(addr, true);
 
-  return std::string(reinterpret_cast<const char*>(page.value.get()), page.size);
+  return std::string(reinterpret_cast<const char*>(page.value.get_readonly()), page.size);
+}
+
+// Get pointer to write value directly.
+uint8_t* VMemory::Accessor::read_writable(vaddr_t src, uint64_t length) {
+  vaddr_t upper = get_upper_addr(src);
+  vaddr_t lower = get_lower_addr(src);
+
+  Page& page = get_page(upper, true);
+  assert(page.size >= lower);
+  uint64_t end = (length == 0 || lower + length > page.size) ? page.size : lower + length;
+
+  auto it = raw_writable.find(upper);
+  if (it != raw_writable.end()) {
+    if (lower < it->second.begin) it->second.begin = lower;
+    if (end > it->second.end) it->second.end = end;
+    if (page.type == PT_MASTER) return page.value.get() + lower;
+    return it->second.copy.get() + lower;
+  }
+
+  WritableArea& area = raw_writable[upper];
+  area.begin = lower;
+  area.end = end;
+  if (page.type == PT_MASTER) {
+    // Keep master flag while the pointer is used, storage is not moved by other access.
+    page.master_count++;
+    return page.value.get() + lower;
+  }
+
+  area.copy.allocate(page.size);
+  area.copy.store(0, page.value.get_readonly(), page.size);
+  return area.copy.get() + lower;
 }
 
-// Write out the data selected by get_raw_writable.
+// Write out the data selected by read_writable.
 void VMemory::Accessor::write_out() {
   auto it = raw_writable.begin();
 
   while (it != raw_writable.end()) {
     Page& page = get_page(it->first, false);
+    uint64_t begin = it->second.begin;
+    uint64_t end = std::min(it->second.end, page.size);
     switch (page.type) {
       case PT_MASTER: {
-        page.value.swap(it->second);
-        for (auto& it_hint : page.hint) {
-          vmemory.send_command_copy(it_hint, space, page, it->first);
-        }
+        assert(page.master_count > 0);
+        page.master_count--;
+        if (begin < end) vmemory.update_master(space, page, it->first, begin, end - begin);
       } break;
 
       case PT_COPY: {
-        assert(page.hint.size() == 1);
-        page.flg_update = false;
-        vmemory.send_command_update(*page.hint.begin(), space, it->first,
-                                    it->second.get(), page.size);
+        // Send only the changed range, the copy keeps value before writing.
+        const uint8_t* data = it->second.copy.get_readonly();
+        const uint8_t* old = page.value.get_readonly();
+        while (begin < end && data[begin] == old[begin]) begin++;
+        while (begin < end && data[end - 1] == old[end - 1]) end--;
+        if (begin < end) {
+          vmemory.write_remote(space, page, it->first,
+                               {RemoteOp::STORE, begin, end - begin,
+                                std::string(reinterpret_cast<const char*>(data) + begin,
+                                            end - begin), 0, 0, 0, 0});
+        }
       } break;
 
       default: {
@@ -1051,48 +2479,208 @@ void VMemory::Accessor::write_out() {
   }
 }
 
-/**
- * For debug, show all memory dump there are store in this node.
- * This method is usable when compiled by debug mode, otherwise, this method do nothing.
- */
-void VMemory::Accessor::print_dump() {
-#ifndef NDEBUG
-  for (auto& it_page : space.pages) {
-    vaddr_t addr = it_page.first;
-    Page& page = it_page.second;
+// Execute atomic read-modify-write operation for integer value.
+std::string VMemory::Accessor::atomic(vaddr_t dst, AtomicType type, const std::string& operand,
+                                      const std::string& compare) {
+  if (atomic_waiting != 0) {
+    auto it_result = space.atomic_results.find(atomic_waiting);
+    if (it_result == space.atomic_results.end()) {
+      throw InterruptMemoryRequire(get_upper_addr(dst));
+    }
+    return it_result->second;
+  }
+
+  Page& page = get_page(get_upper_addr(dst), false);
+  switch (page.type) {
+    case PT_MASTER: {
+      std::string old = apply_atomic(page, get_lower_addr(dst), type, operand, compare);
+      vmemory.update_master(space, page, get_upper_addr(dst), get_lower_addr(dst),
+                            operand.size());
+      atomic_waiting = ++space.atomic_serial;
+      space.atomic_results[atomic_waiting] = old;
+      return old;
+    } break;
+
+    case PT_COPY: {
+      assert(page.hint.size() == 1);
+      atomic_waiting = ++space.atomic_serial;
+      AtomicRequest& request = space.atomic_requests[atomic_waiting];
+      request.addr = dst;
+      request.type = type;
+      request.operand = operand;
+      request.compare = compare;
+      request.time = Util::get_clock_ms();
+      vmemory.send_command_atomic(*page.hint.begin(), space, dst, type, operand, compare,
+                                  atomic_waiting, vmemory.my_nid);
+      throw InterruptMemoryRequire(get_upper_addr(dst));
+    } break;
+
+    default: {
+      /// @todo error
+      assert(false);
+      return std::string();
+    } break;
+  }
+}
+
+// Release result of atomic operation after output of the instruction is written.
+void VMemory::Accessor::finish_atomic() {
+  space.atomic_results.erase(atomic_waiting);
+  atomic_waiting = 0;
+}
+
+// Require pages that will be used soon by one command without waiting.
+void VMemory::Accessor::prefetch(const std::vector<vaddr_t>& addrs) {
+  std::map<nid_t, std::vector<vaddr_t>> require;
+
+  for (auto addr : addrs) {
+    assert(addr == get_upper_addr(addr));
+    if (addr == VADDR_NULL || space.requiring.find(addr) != space.requiring.end()) continue;
+
+    auto it_page = space.pages.find(addr);
+    if (it_page == space.pages.end()) {
+      require[vmemory.get_location(space, addr)].push_back(addr);
+
+    } else if (it_page->second.flg_update == false) {
+      assert(it_page->second.type == PT_COPY && it_page->second.hint.size() == 1);
+      require[*it_page->second.hint.begin()].push_back(addr);
 
-    Logger::dbg_raw(CoreMid::L1007, "addr:%s", Convert::vaddr2str(addr).c_str());
-    if ((addr & AddressRegion::MASK) == AddressRegion::META) {
-      Logger::dbg_raw(CoreMid::L1007, "value:%s",
-                      std::string(reinterpret_cast<const char*>(page.value.get()), page.size).
-                      c_str());
-
-    } else if ((addr & AddressRegion::MASK) == AddressRegion::PROGRAM) {
-      picojson::value v;
-      picojson::parse(v, std::string(reinterpret_cast<char*>(page.value.get()), page.size));
-      Logger::dbg_raw(CoreMid::L1007, v.serialize(true));
-      if (v.get<picojson::object>().at("program_type").get<std::string>() == "01") {
-        Logger::dbg_raw(CoreMid::L1007, "code:");
-        for (auto& code : v.get<picojson::object>().at("code").get<picojson::array>()) {
-          Logger::dbg_raw(CoreMid::L1007, "  %s", Util::code2str(Convert::json2code(code)).c_str());
-        }
-      }
     } else {
-      Logger::dbg_raw(CoreMid::L1007, "value(size=%" PRIu64 "):", page.size);
-      std::string tmp;
-      for (unsigned int i = 0; i < page.size; i ++) {
-        if (i % 16 == 0) {
-          if (i != 0) {
-            Logger::dbg_raw(CoreMid::L1007, tmp);
-          }
-          tmp = Convert::vaddr2str(addr + i) + " : ";
-        }
-        tmp += Convert::int2str(0xFF & page.value[i]) + " ";
+      continue;
+    }
+    space.requiring.insert(addr);
+  }
+
+  for (auto& it : require) {
+    vmemory.send_command_require_batch(it.first, space.name, vmemory.my_nid, it.second,
+                                       0, 0, 0, 0);
+  }
+}
+
+// Give master flag of pages used by a thread to another node with warp command.
+picojson::array VMemory::Accessor::give_bundle(const std::vector<vaddr_t>& addrs,
+                                               const nid_t& dst_nid,
+                                               const std::set<vaddr_t>& precopied) {
+  picojson::array bundle;
+
+  for (auto addr : get_working_set(addrs)) {
+    give_page(addr, space.pages.find(addr)->second, dst_nid, precopied, bundle);
+  }
+
+  return bundle;
+}
+
+// Give master flag of all pages this node is master of in the space with warp command.
+picojson::array VMemory::Accessor::give_space(const nid_t& dst_nid,
+                                              const std::set<vaddr_t>& precopied) {
+  picojson::array bundle;
+
+  for (auto& it_page : space.pages) {
+    if (it_page.second.type != PT_MASTER) continue;
+    give_page(it_page.first, it_page.second, dst_nid, precopied, bundle);
+  }
+
+  return bundle;
+}
+
+// Send copy of pages used by a thread to warp destination before stopping the thread.
+picojson::array VMemory::Accessor::copy_bundle(const std::vector<vaddr_t>& addrs,
+                                               const nid_t& dst_nid, std::set<vaddr_t>& sent,
+                                               uint64_t& dirty) {
+  picojson::array bundle;
+  uint64_t now = Util::get_clock_ms();
+  dirty = 0;
+
+  for (auto addr : get_working_set(addrs)) {
+    Page& page = space.pages.find(addr)->second;
+    if (sent.find(addr) != sent.end() && page.hint.find(dst_nid) != page.hint.end()) {
+      // Changes are sent by copy command, count them until the destination acknowledges.
+      if (page.send_copy_history.find(dst_nid) != page.send_copy_history.end()) {
+        dirty += page.size;
       }
-      Logger::dbg_raw(CoreMid::L1007, tmp);
+      continue;
     }
+
+    picojson::object param;
+    param.insert(std::make_pair("addr", Convert::vaddr2json(addr)));
+    value2json(param, page.value, 0, page.size);
+    param.insert(std::make_pair("version", Convert::int2json(page.version)));
+    vmemory.count_message(space.stats.sent, "copy", param);
+    bundle.push_back(picojson::value(param));
+
+    page.hint.insert(dst_nid);
+    SendCopyHistory& history = page.send_copy_history[dst_nid];
+    history.version = page.version;
+    history.time = now;
+    history.pending_begin = history.pending_end = 0;
+    sent.insert(addr);
+    dirty += page.size;
   }
-#endif
+
+  return bundle;
+}
+
+// Estimate pages given with warp of a thread.
+void VMemory::Accessor::estimate_warp(const std::vector<vaddr_t>& addrs,
+                                      uint64_t& pages, uint64_t& bytes) {
+  pages = 0;
+  bytes = 0;
+  for (auto addr : get_working_set(addrs)) {
+    pages++;
+    bytes += space.pages.find(addr)->second.size;
+  }
+}
+
+/**
+ * Select master pages used by a thread to move them with warp.
+ * Pages in addrs are selected always, and pages in translation cache are selected within the
+ * warp budget of the space.
+ * @param addrs Addresses of pages the thread needs to resume.
+ * @return Upper addresses of selected pages.
+ */
+std::vector<vaddr_t> VMemory::Accessor::get_working_set(const std::vector<vaddr_t>& addrs) {
+  std::vector<vaddr_t> selected;
+  std::set<vaddr_t> checked;
+  auto select = [&](vaddr_t addr) -> uint64_t {
+    if (addr == VADDR_NULL || !checked.insert(addr).second) return 0;
+    auto it_page = space.pages.find(addr);
+    if (it_page == space.pages.end() || it_page->second.type != PT_MASTER) return 0;
+    selected.push_back(addr);
+    return it_page->second.size;
+  };
+
+  for (auto addr : addrs) {
+    select(get_upper_addr(addr));
+  }
+
+  // Translation cache keeps pages accessed by this thread recently.
+  if (cache_generation != space.pages.get_generation()) flush_cache();
+  uint64_t bytes = 0;
+  for (auto& entry : cache) {
+    if (bytes >= space.warp_budget) break;
+    bytes += select(entry.addr);
+  }
+
+  return selected;
+}
+
+/**
+ * Give master flag of a page to warp destination, adding parameter of give to bundle.
+ * Page kept by master key is skipped.
+ * @param addr Upper address of the page.
+ * @param page Target page, this node must be master of it.
+ * @param dst_nid Node-id to give master flag.
+ * @param precopied Pages sent by copy_bundle to the destination.
+ * @param bundle Parameters of give are added to this.
+ */
+void VMemory::Accessor::give_page(vaddr_t addr, Page& page, const nid_t& dst_nid,
+                                  const std::set<vaddr_t>& precopied, picojson::array& bundle) {
+  if (page.master_count != 0) return;
+  // Destination has latest value if it is a copy node and acknowledged all copies.
+  bool with_value = precopied.find(addr) == precopied.end() ||
+      page.hint.find(dst_nid) == page.hint.end() ||
+      page.send_copy_history.find(dst_nid) != page.send_copy_history.end();
+  vmemory.give_master(space, page, addr, dst_nid, &bundle, with_value);
 }
 
 // Constructor with value by string.
@@ -1100,12 +2688,12 @@ VMemory::Page::Page(PageType type_, bool flg_update_,
                     const std::string& value_str, const std::set<nid_t>& hint_) :
     type(type_),
     flg_update(flg_update_),
-    value(new uint8_t[value_str.size()]),
     size(value_str.size()),
     hint(hint_),
     master_count(0),
-    referral_count(0) {
-  std::memcpy(value.get(), value_str.data(), size);
+    version(1) {
+  value.allocate(size);
+  value.store(0, reinterpret_cast<const uint8_t*>(value_str.data()), size);
 }
 
 // Constructor without initialize value.
@@ -1115,7 +2703,71 @@ VMemory::Page::Page(PageType type_, bool flg_update_, const std::set<nid_t>& hin
     size(0),
     hint(hint_),
     master_count(0),
-    referral_count(0) {
+    version(1) {
+}
+
+// Check a range can read.
+bool VMemory::Page::is_readable(uint64_t offset, uint64_t length) const {
+  if (flg_update || chunks.empty()) return flg_update;
+  if (length == 0) return false;
+
+  uint64_t end = std::min(offset + length, size);
+  for (uint64_t idx = offset / VMemoryChunk::SIZE; idx * VMemoryChunk::SIZE < end; idx++) {
+    if (!chunks.at(idx)) return false;
+  }
+  return true;
+}
+
+// Change flag of chunks in a range for chunked page, or flg_update for other page.
+void VMemory::Page::set_readable(uint64_t offset, uint64_t length, bool flg) {
+  if (chunks.empty()) {
+    flg_update = flg;
+    return;
+  }
+
+  if (length == 0) {
+    offset = 0;
+    length = size;
+  }
+  uint64_t end = std::min(offset + length, size);
+  for (uint64_t idx = offset / VMemoryChunk::SIZE; idx * VMemoryChunk::SIZE < end; idx++) {
+    chunks.at(idx) = flg;
+  }
+  flg_update = flg && std::find(chunks.begin(), chunks.end(), false) == chunks.end();
+}
+
+// Store value received by copy command.
+void VMemory::Page::store_copy(const uint8_t* data, uint64_t length, uint64_t offset,
+                               uint64_t whole_size, bool is_chunk) {
+  if (size != whole_size) {
+    size = whole_size;
+    value.allocate(size);
+    chunks.clear();
+    flg_update = false;
+  }
+
+  if (is_chunk) {
+    assert(offset + length <= size);
+    if (chunks.empty()) {
+      chunks.assign((size + VMemoryChunk::SIZE - 1) / VMemoryChunk::SIZE, flg_update);
+    }
+    if (data == nullptr) {
+      value.fill_zero(offset, length);
+    } else {
+      value.store(offset, data, length);
+    }
+    set_readable(offset, length, true);
+
+  } else {
+    assert(length == size);
+    if (data == nullptr) {
+      value.allocate(size);
+    } else {
+      value.store(0, data, size);
+    }
+    chunks.clear();
+    flg_update = true;
+  }
 }
 
 // Constructor with name and random.
@@ -1123,11 +2775,29 @@ VMemory::Space::Space(const std::string& name_, std::mt19937_64& rnd_, VMemory&
     name(name_),
     rnd(rnd_),
     vmemory(vmemory_),
-    is_loading(false) {
+    is_loading(false),
+    is_prefetch(false),
+    stats(),
+    copy_budget(VMemoryCopyCache::BUDGET),
+    copy_bytes(0),
+    clock_hand(0),
+    warp_budget(VMemoryWarp::BUDGET),
+    atomic_serial(0),
+    update_serial(0),
+    lease_partition(get_lease_partition(vmemory_.my_nid)) {
+  for (auto& cursor : lease_cursor) {
+    cursor = rnd();
+  }
 }
 
 // Get a new address to allocate a new memory.
 vaddr_t VMemory::Space::assign_addr(AddressRegion::Type type) {
+  // Shared or exhausted lease falls back to reserve command.
+  if (is_leased_region(type) && !vmemory.is_lease_shared) {
+    vaddr_t addr = assign_leased_addr(type);
+    if (addr != VADDR_NULL) return addr;
+  }
+
   std::deque<vaddr_t>& reserved_que = reserved[type >> 60];
   std::set<vaddr_t> new_reserve;
   Finally finally;
@@ -1147,6 +2817,16 @@ vaddr_t VMemory::Space::assign_addr(AddressRegion::Type type) {
         continue;
       }
 
+      // Partitions known to be leased by some node are assigned without reserve command.
+      if (is_leased_region(type)) {
+        vaddr_t partition = get_lease_partition(new_addr);
+        if (partition == lease_partition ||
+            vmemory.partition_nids.find(partition) != vmemory.partition_nids.end() ||
+            vmemory.shared_partitions.find(partition) != vmemory.shared_partitions.end()) {
+          continue;
+        }
+      }
+
       if (pages.find(new_addr) == pages.end() &&
           new_reserve.find(new_addr) == new_reserve.end() &&
           reserved_set.find(new_addr) == reserved_set.end()) {
@@ -1178,8 +2858,43 @@ vaddr_t VMemory::Space::assign_addr(AddressRegion::Type type) {
   return r;
 }
 
+/**
+ * Get a new address from this node's lease.
+ * Address is made by region, partition index and cursor, the cursor is increased sequentially and
+ * addresses that this node has a page yet or knows master of are skipped.
+ * @param type Address-type of memory, it must be leased region.
+ * @return A new address, VADDR_NULL if the lease is exhausted.
+ */
+vaddr_t VMemory::Space::assign_leased_addr(AddressRegion::Type type) {
+  assert(is_leased_region(type));
+  unsigned int lower_bits = get_lower_bits(type);
+  unsigned int free_bits = 60 - lower_bits - VMemoryLease::PARTITION_BITS;
+  vaddr_t partition = lease_partition << (60 - VMemoryLease::PARTITION_BITS);
+  vaddr_t cursor_mask = (static_cast<vaddr_t>(1) << free_bits) - 1;
+  vaddr_t& cursor = lease_cursor[type >> 60];
+
+  for (vaddr_t retry = 0; retry <= cursor_mask; retry++) {
+    cursor = (cursor + 1) & cursor_mask;
+    vaddr_t new_addr = type | partition | (cursor << lower_bits);
+
+    if (type == AddressRegion::META && new_addr <= 0xFF) {
+      continue;
+    }
+
+    // Page assigned before may be moved to another node, it is in the directory then.
+    if (pages.find(new_addr) == pages.end() && locations.find(new_addr) == locations.end()) {
+      return new_addr;
+    }
+  }
+
+  return VADDR_NULL;
+}
+
 // Release a binded address for be used memory to be unused.
 void VMemory::Space::release_addr(vaddr_t addr) {
+  // Address in lease is reused when the cursor come around.
+  if (is_leased_region(addr & AddressRegion::MASK) && !vmemory.is_lease_shared) return;
+
   std::deque<vaddr_t>& reserved_que = reserved[addr >> 60];
   reserved_que.push_front(addr);
 
@@ -5,16 +5,21 @@
 #include <cassert>
 #include <deque>
 #include <functional>
+#include <iosfwd>
 #include <map>
 #include <memory>
 #include <random>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "constant.hpp"
 #include "constant_vm.hpp"
 #include "convert.hpp"
 #include "interrupt_memory_require.hpp"
+#include "migration_policy.hpp"
+#include "page_buffer.hpp"
+#include "page_table.hpp"
 #include "type.hpp"
 #include "util.hpp"
 
@@ -45,10 +50,116 @@ class VMemory {
     PT_PROGRAM,
   };
 
+  /** Kind of atomic read-modify-write operation executed by master of the page. */
+  enum AtomicType {
+    AT_XCHG,
+    AT_ADD,
+    AT_SUB,
+    AT_AND,
+    AT_NAND,
+    AT_OR,
+    AT_XOR,
+    AT_MAX,
+    AT_MIN,
+    AT_UMAX,
+    AT_UMIN,
+    AT_CMPXCHG,
+  };
+
   /** History of copy command for some page. */
   struct SendCopyHistory {
-    uint64_t key;
-    std::time_t time;
+    /** Version of value sent at last. */
+    uint64_t version;
+    /** Time sent at last (msec). */
+    uint64_t time;
+    /** Begin of range inhibited to send, that is sent when reply is received. */
+    uint64_t pending_begin;
+    /** End of range inhibited to send, same as begin if there is no range. */
+    uint64_t pending_end;
+  };
+
+  /**
+   * Memory operation executed by master for a write on copy page.
+   * Copy node applies it to own copy soon, and applies it again over copies received until
+   * master acknowledges it.
+   */
+  struct RemoteOp {
+    enum Type {
+      STORE,
+      FILL,
+      MOVE,
+    };
+    Type type;
+    /** Begin of written range in the page. */
+    uint64_t offset;
+    /** Length of written range. */
+    uint64_t length;
+    /** Value to store, for STORE. */
+    std::string data;
+    /** Value to fill, for FILL. */
+    uint8_t c;
+    /** Begin of source range in the same page, for MOVE. */
+    uint64_t src;
+    /** Serial number given by the node that began it, 0 if the reply isn't waited. */
+    uint64_t serial;
+    /** Time sent at last (msec). */
+    uint64_t time;
+  };
+
+  /** Page required by prefetch of pointers. */
+  struct PrefetchEntry {
+    /** Depth of pointer chasing. */
+    unsigned int depth;
+    /** Time required (msec). */
+    uint64_t time;
+  };
+
+  /** Page received by pre-copy of warp. */
+  struct PrecopyEntry {
+    /** Node-id sent the copy. */
+    nid_t src_nid;
+    /** Thread-id the copy is sent for. */
+    vtid_t tid;
+    /** Time received (msec). */
+    uint64_t time;
+  };
+
+  /** Atomic operation sent to master and waiting for reply. */
+  struct AtomicRequest {
+    vaddr_t addr;
+    AtomicType type;
+    std::string operand;
+    std::string compare;
+    /** Time sent at last (msec). */
+    uint64_t time;
+  };
+
+  /** Value of a page kept by snapshot. */
+  struct PageImage {
+    PageType type;
+    uint64_t size;
+    uint64_t version;
+    /** Value, storage is shared with the page until one of them is written. */
+    PageBuffer value;
+  };
+
+  /** Count and size of page value of commands. */
+  struct MessageStats {
+    uint64_t count;
+    /** Bytes of page value carried by commands. */
+    uint64_t bytes;
+  };
+
+  /** Statistics of a memory space, counted cheaply while running. */
+  struct SpaceStats {
+    /** Count of page accesses by accessors. */
+    uint64_t access;
+    /** Count of accesses that required page from another node. */
+    uint64_t miss;
+    /** Command name and statistics of sent commands. */
+    std::map<std::string, MessageStats> sent;
+    /** Command name and statistics of received commands. */
+    std::map<std::string, MessageStats> recv;
   };
 
   /** */
@@ -58,17 +169,29 @@ class VMemory {
     /** True if can read. */
     bool flg_update;
     /** */
-    std::unique_ptr<uint8_t[]> value;
+    PageBuffer value;
     /** */
     uint64_t size;
     /** */
     std::set<nid_t> hint;
     /** Reference count to use to master. */
     int master_count;
-    /** Access count for change owner or occasion to copy. */
-    int referral_count;
+    /**
+     * Version of value, master increases it for every change.
+     * It starts from 1, 0 is used by a node doesn't have value.
+     */
+    uint64_t version;
+    /** Access statistics for migration policy. */
+    PageStats stats;
     /** History of copy command for some node. */
     std::map<nid_t, SendCopyHistory> send_copy_history;
+    /** Operations sent to master from copy page and not acknowledged yet. */
+    std::deque<RemoteOp> updating;
+    /**
+     * True if each chunk can read, for chunked copy page.
+     * Empty if the page is not chunked, use flg_update instead of it.
+     */
+    std::vector<bool> chunks;
 
     /**
      * Constructor with value by string.
@@ -80,6 +203,34 @@ class VMemory {
      * Constructor without initialize value.
      */
     Page(PageType type, bool flg_update, const std::set<nid_t>& hint);
+
+    /**
+     * Check a range can read.
+     * @param offset Begin of range in the page.
+     * @param length Length of range, whole of page if 0.
+     * @return True if all of chunks in range can read.
+     */
+    bool is_readable(uint64_t offset, uint64_t length) const;
+
+    /**
+     * Change flag of chunks in a range for chunked page, or flg_update for other page.
+     * @param offset Begin of range in the page.
+     * @param length Length of range, whole of page if 0.
+     * @param flg True if range can read.
+     */
+    void set_readable(uint64_t offset, uint64_t length, bool flg);
+
+    /**
+     * Store value received by copy command.
+     * Page is resized if whole size is changed, and all chunks are unreadable in that case.
+     * @param data Received value, whole of page or chunks, nullptr if the value is zero.
+     * @param length Length of received value.
+     * @param offset Begin of received chunks.
+     * @param whole_size Size of whole of page.
+     * @param is_chunk True if received value is some chunks.
+     */
+    void store_copy(const uint8_t* data, uint64_t length, uint64_t offset, uint64_t whole_size,
+                    bool is_chunk);
   };
 
   static const vaddr_t UPPER_MASKS[];
@@ -96,6 +247,66 @@ class VMemory {
     return (addr & AddressRegion::MASK) == AddressRegion::PROGRAM;
   }
 
+  /**
+   * Check a page having the size is transfered by chunk.
+   * @param size Size of page.
+   * @return True if the page is chunked.
+   */
+  static bool is_chunked(uint64_t size) {
+    return size > VMemoryChunk::SIZE;
+  }
+
+  /**
+   * Get bit width of lower address for a region.
+   * @param type Address-type of memory.
+   * @return Bit width of lower address.
+   */
+  static unsigned int get_lower_bits(AddressRegion::Type type) {
+    vaddr_t mask = UPPER_MASKS[type >> 60];
+    unsigned int bits = 0;
+    while (bits < 60 && ((mask >> bits) & 0x1) == 0) bits++;
+    return bits;
+  }
+
+  /**
+   * Check a region is assigned by lease (partition of node) or reserve command.
+   * @param type Address-type of memory.
+   * @return True if the region has enough bits to be partitioned.
+   */
+  static bool is_leased_region(AddressRegion::Type type) {
+    return 60 - get_lower_bits(type) >=
+        VMemoryLease::PARTITION_BITS + VMemoryLease::MIN_FREE_BITS;
+  }
+
+  /**
+   * Get lease partition index that a node assigns addresses from.
+   * @param nid Node-id.
+   * @return Partition index.
+   */
+  static vaddr_t get_lease_partition(const nid_t& nid) {
+    return Util::calc_fnv1a(nid) & ((static_cast<vaddr_t>(1) << VMemoryLease::PARTITION_BITS) - 1);
+  }
+
+  /**
+   * Get lease partition index of an address in leased region.
+   * @param addr Target address.
+   * @return Partition index.
+   */
+  static vaddr_t get_lease_partition(vaddr_t addr) {
+    return (addr & ~AddressRegion::MASK) >> (60 - VMemoryLease::PARTITION_BITS);
+  }
+
+  /**
+   * Insert value of a range into parameter of command.
+   * Zero range is sent as "zero" with the length instead of "value".
+   * @param param Parameter of command.
+   * @param value Buffer of page.
+   * @param offset Begin of range.
+   * @param length Length of range.
+   */
+  static void value2json(picojson::object& param, PageBuffer& value,
+                         uint64_t offset, uint64_t length);
+
   /** Bundle pages in memory space. */
   class Space {
    public:
@@ -107,9 +318,53 @@ class VMemory {
     VMemory& vmemory;
     /** Switch of loading mode. */
     bool is_loading;
-    /** Map of page name and page space having on this node. */
-    std::map<vaddr_t, Page> pages;
+    /** Switch of prefetch for pages pointed by arrived page. */
+    bool is_prefetch;
+    /** Table of page name and page space having on this node. */
+    PageTable<Page> pages;
     std::set<vaddr_t> requiring;
+    /** Directory of master node for pages this node doesn't have. */
+    PageTable<nid_t> locations;
+    /**
+     * Map of address requiring by prefetch and depth of pointer chasing.
+     * Value that looks like a pointer may not be allocated, entry is dropped without reply.
+     */
+    std::map<vaddr_t, PrefetchEntry> prefetching;
+    /** Statistics of this space. */
+    SpaceStats stats;
+    /** Limit of bytes of copy pages, those are evicted by CLOCK over it. */
+    uint64_t copy_budget;
+    /** Bytes of copy pages, may be larger than actual, recounted before eviction. */
+    uint64_t copy_bytes;
+    /** Slot position of the hand of CLOCK in pages. */
+    size_t clock_hand;
+    /** Limit of bytes of recently accessed pages given with warp of a thread. */
+    uint64_t warp_budget;
+    /**
+     * Pages received by pre-copy of warp, they are kept until master flag is given, the warp
+     * arrives without giving them, or PRECOPY_TIMEOUT passes.
+     */
+    std::map<vaddr_t, PrecopyEntry> precopied;
+    /** Last serial number of atomic operation sent from this node. */
+    uint64_t atomic_serial;
+    /** Serial number and old value of atomic operation, kept until the instruction finishes. */
+    std::map<uint64_t, std::string> atomic_results;
+    /** Serial number and atomic operation waiting for reply, resent per interval. */
+    std::map<uint64_t, AtomicRequest> atomic_requests;
+    /**
+     * Origin node-id, serial number and reply of atomic operation executed by this node.
+     * Resent operation is replied again without executing it twice.
+     */
+    std::map<nid_t, std::map<uint64_t, picojson::object>> atomic_replies;
+    /** Last serial number of memory operation sent from copy pages in this node. */
+    uint64_t update_serial;
+    /** Copy pages having operations not acknowledged by master, resent per interval. */
+    std::set<vaddr_t> updating;
+    /**
+     * Origin node-id, serial number and version replied for memory operation executed by this
+     * node. Resent operation is replied again without executing it twice.
+     */
+    std::map<nid_t, std::map<uint64_t, uint64_t>> update_replies;
 
     /**
      * Constructor with name and random.
@@ -121,6 +376,7 @@ class VMemory {
 
     /**
      * Get a new address to allocate a new memory.
+     * Wide regions are assigned from this node's lease, narrow regions are reserved by command.
      * @param type Address-type of memory.
      */
     vaddr_t assign_addr(AddressRegion::Type type);
@@ -132,6 +388,13 @@ class VMemory {
     void release_addr(vaddr_t addr);
 
    private:
+    /** Partition index of this node in leased regions. */
+    const vaddr_t lease_partition;
+    /**
+     * Last assigned position in the lease.
+     * Grouped by vaddr_t of head 4bit, start position is random to avoid collision in partition.
+     */
+    vaddr_t lease_cursor[16];
     /**
      * Reserved addresses.
      * A higher priority address placed front of the deque.
@@ -139,6 +402,13 @@ class VMemory {
      */
     std::deque<vaddr_t> reserved[16];
 
+    /**
+     * Get a new address from this node's lease.
+     * @param type Address-type of memory, it must be leased region.
+     * @return A new address, VADDR_NULL if the lease is exhausted.
+     */
+    vaddr_t assign_leased_addr(AddressRegion::Type type);
+
     /** Block copy operator. */
     Space& operator=(const Space&);
 
@@ -162,17 +432,35 @@ class VMemory {
     return AddressRegion::VALUE_08;
   }
 
+  void update_master(Space& space, Page& page, vaddr_t addr,
+                     uint64_t offset = 0, uint64_t length = 0);
+  void send_command_atomic(const nid_t& dst_nid, Space& space, vaddr_t addr, AtomicType type,
+                           const std::string& operand, const std::string& compare,
+                           uint64_t serial, const nid_t& origin);
   void send_command_copy(const nid_t& dst_nid, Space& space, Page& page, vaddr_t addr);
-  void send_command_copy_reply(const nid_t& dst_nid, Space& space, vaddr_t addr, uint64_t key);
+  void send_command_copy(const nid_t& dst_nid, Space& space, Page& page, vaddr_t addr,
+                         uint64_t offset, uint64_t length);
+  void send_command_copy_reply(const nid_t& dst_nid, Space& space, vaddr_t addr,
+                               uint64_t version);
   void send_command_free(const nid_t& dst_nid, Space& space, vaddr_t addr);
   void send_command_give(Space& space, Page& page, vaddr_t addr, const nid_t& dst);
+  static picojson::object give2json(Page& page, vaddr_t addr, const nid_t& dst_nid,
+                                    bool with_value);
   void send_command_release(Space& space, std::set<vaddr_t> addrs);
-  void send_command_require(const nid_t& dst_nid, Space& space, vaddr_t addr);
+  void send_command_require(const nid_t& dst_nid, Space& space, vaddr_t addr,
+                            uint64_t offset, uint64_t length, uint64_t version);
+  void send_command_require_batch(const nid_t& dst_nid, const std::string& name,
+                                  const nid_t& src_nid, const std::vector<vaddr_t>& addrs,
+                                  unsigned int hop, uint64_t offset, uint64_t length,
+                                  uint64_t version);
   void send_command_reserve(Space& space, std::set<vaddr_t> addrs);
   void send_command_stand(Space& space, Page& page, vaddr_t addr);
   void send_command_unwant(const nid_t& dst_nid, const std::string name, vaddr_t addr);
   void send_command_update(const nid_t& dst_nid, Space& space, vaddr_t addr,
-                           const uint8_t* data, uint64_t size);
+                           const RemoteOp& op, const nid_t& origin);
+  void send_command_update_reply(const nid_t& dst_nid, Space& space, vaddr_t addr,
+                                 uint64_t version, uint64_t serial, bool is_rejected);
+  void write_remote(Space& space, Page& page, vaddr_t addr, RemoteOp&& op);
 
  public:
   /** This node's node-id. */
@@ -193,32 +481,73 @@ class VMemory {
     /** Accessing memory space. */
     Space& space;
 
+    /** Entry of translation cache, upper address and page. */
+    struct CacheEntry {
+      vaddr_t addr;
+      Page* page;
+    };
+    /** Direct mapped translation cache for recently accessed pages. */
+    CacheEntry cache[VMemoryCache::SIZE];
+    /** Generation of page table when the cache was validated. */
+    uint64_t cache_generation;
+
+    /**
+     * Clear all entries in translation cache.
+     */
+    void flush_cache() {
+      for (auto& entry : cache) {
+        entry.addr = VADDR_NULL;
+        entry.page = nullptr;
+      }
+      cache_generation = space.pages.get_generation();
+    }
+
     /**
      * Get a memory page by a address.
      * Raise exception of require if data is old or don't exist in this node.
+     * Look up translation cache at first, cached pages are dropped when some page was erased.
+     * Only chunks in the range are required for large page if the range is set.
      * @param addr
      * @param readable
+     * @param offset Begin of range to read.
+     * @param length Length of range to read, whole of page if 0.
      * @return
      */
-    Page& get_page(vaddr_t addr, bool readable) {
+    Page& get_page(vaddr_t addr, bool readable, uint64_t offset = 0, uint64_t length = 0) {
       assert(addr != VADDR_NULL);
       assert((addr & AddressRegion::MASK) == AddressRegion::META ||
              (addr & AddressRegion::MASK) == AddressRegion::PROGRAM ||
              addr == get_upper_addr(addr));
-      auto page = space.pages.find(addr);
-
-      if (page == space.pages.end()) {
-        vmemory.send_command_require(NID::BROADCAST, space, addr);
-        throw InterruptMemoryRequire(addr);
+      if (cache_generation != space.pages.get_generation()) flush_cache();
+      space.stats.access++;
+
+      CacheEntry& entry =
+          cache[(addr * 0x9E3779B97F4A7C15ULL) >> (64 - VMemoryCache::BITS)];
+      if (entry.addr != addr) {
+        auto it_page = space.pages.find(addr);
+
+        if (it_page == space.pages.end()) {
+          space.stats.miss++;
+          vmemory.send_command_require(vmemory.get_location(space, addr), space, addr,
+                                       offset, length, 0);
+          throw InterruptMemoryRequire(addr);
+        }
+        entry.addr = addr;
+        entry.page = &it_page->second;
+      }
 
-      } else if (readable && page->second.flg_update == false) {
-        assert(page->second.type == PT_COPY && page->second.hint.size() == 1);
-        vmemory.send_command_require(*(page->second.hint.begin()), space, addr);
+      Page& page = *entry.page;
+      if (readable && page.flg_update == false && !page.is_readable(offset, length)) {
+        assert(page.type == PT_COPY && page.hint.size() == 1);
+        space.stats.miss++;
+        // Ask newer value than this copy, version is not enough for partially received page.
+        vmemory.send_command_require(*(page.hint.begin()), space, addr, offset, length,
+                                     page.chunks.empty() ? page.version : 0);
         throw InterruptMemoryRequire(addr);
       }
-      assert(page->second.type == PT_MASTER || page->second.master_count == 0);
-      page->second.referral_count = 0;
-      return page->second;
+      assert(page.type == PT_MASTER || page.master_count == 0);
+      page.stats.record_local();
+      return page;
     }
 
    public:
@@ -257,6 +586,14 @@ class VMemory {
      */
     std::string get_meta_area(vaddr_t addr);
 
+    /**
+     * Get version of meta data, it changes when master or another node changes the data.
+     * Use this to skip reading the data not changed.
+     * @param addr Target Address.
+     * @return Version.
+     */
+    uint64_t get_meta_version(vaddr_t addr);
+
     /**
      * Change meta data.
      * @param addr Target address.
@@ -264,6 +601,15 @@ class VMemory {
      */
     void update_meta_area(vaddr_t addr, const std::string& data);
 
+    /**
+     * Change a range of meta data without changing the size.
+     * @param addr Target address.
+     * @param offset Begin of range.
+     * @param data Pointer to data.
+     * @param length Length of data.
+     */
+    void update_meta_area(vaddr_t addr, uint64_t offset, const uint8_t* data, uint64_t length);
+
     /**
      * Reserve address in program area.
      * This method must use when loading program only.
@@ -318,19 +664,19 @@ class VMemory {
 
       switch (page.type) {
         case PT_MASTER: {
-          std::memset(page.value.get() + get_lower_addr(dst), c, size);
-          for (auto& it_hint : page.hint) {
-            vmemory.send_command_copy(it_hint, space, page, get_upper_addr(dst));
+          if (c == 0 && page.master_count == 0) {
+            // Zero page is kept without storage, unless the storage is pointed by raw pointer.
+            page.value.fill_zero(get_lower_addr(dst), size);
+          } else {
+            std::memset(page.value.get() + get_lower_addr(dst), c, size);
           }
+          vmemory.update_master(space, page, get_upper_addr(dst), get_lower_addr(dst), size);
         } break;
 
         case PT_COPY: {
-          assert(page.hint.size() == 1);
-          page.flg_update = false;
-          std::unique_ptr<char[]> buffer(new char[size]);
-          std::memset(buffer.get(), c, size);
-          vmemory.send_command_update(*page.hint.begin(), space, dst,
-                                      reinterpret_cast<const uint8_t*>(buffer.get()), size);
+          vmemory.write_remote(space, page, get_upper_addr(dst),
+                               {RemoteOp::FILL, get_lower_addr(dst), size, std::string(), c, 0,
+                                0, 0});
         } break;
 
         default: {
@@ -350,17 +696,16 @@ class VMemory {
       switch (page.type) {
         case PT_MASTER: {
           assert(page.size >= get_lower_addr(dst) + sizeof(T));
-          std::memcpy(page.value.get() + get_lower_addr(dst), &val, sizeof(T));
-          for (auto& it_hint : page.hint) {
-            vmemory.send_command_copy(it_hint, space, page, get_upper_addr(dst));
-          }
+          page.value.store(get_lower_addr(dst), reinterpret_cast<const uint8_t*>(&val), sizeof(T));
+          vmemory.update_master(space, page, get_upper_addr(dst), get_lower_addr(dst),
+                                sizeof(T));
         } break;
 
         case PT_COPY: {
-          assert(page.hint.size() == 1);
-          page.flg_update = false;
-          vmemory.send_command_update(*page.hint.begin(), space, dst,
-                                      reinterpret_cast<const uint8_t*>(&val), sizeof(T));
+          vmemory.write_remote(space, page, get_upper_addr(dst),
+                               {RemoteOp::STORE, get_lower_addr(dst), sizeof(T),
+                                std::string(reinterpret_cast<const char*>(&val), sizeof(T)),
+                                0, 0, 0, 0});
         } break;
 
         default: {
@@ -376,9 +721,9 @@ class VMemory {
      * @return Saved value.
      */
     template <typename T> T read(vaddr_t src) {
-      Page& page = get_page(get_upper_addr(src), true);
+      Page& page = get_page(get_upper_addr(src), true, get_lower_addr(src), sizeof(T));
       assert(page.size >= get_lower_addr(src) + sizeof(T));
-      return *reinterpret_cast<const T*>(page.value.get() + get_lower_addr(src));
+      return *reinterpret_cast<const T*>(page.value.get_readonly() + get_lower_addr(src));
     }
 
     /**
@@ -387,49 +732,124 @@ class VMemory {
       Page& page = get_page(get_upper_addr(src), true);
       assert(page.size >= get_lower_addr(src));
 
-      return reinterpret_cast<const uint8_t*>(page.value.get() + get_lower_addr(src));
+      return page.value.get_readonly() + get_lower_addr(src);
     }
 
     /**
+     * Get pointer to write value directly.
+     * Master page is written in place and only marked dirty, copy page is duplicated to send
+     * it to the master. Changes are published by write_out.
+     * Storage of master page is kept in place until write_out, pointer got before another
+     * access to the same page should be got again.
+     * @param src Target address.
+     * @param length Bytes to write, 0 if unknown and the rest of page can be written.
+     * @return Pointer to the value at the address.
      */
-    uint8_t* read_writable(vaddr_t src) {
-      vaddr_t upper = get_upper_addr(src);
-      vaddr_t lower = get_lower_addr(src);
+    uint8_t* read_writable(vaddr_t src, uint64_t length = 0);
 
-      if (raw_writable.find(upper) == raw_writable.end()) {
-        Page& page = get_page(upper, true);
-        std::unique_ptr<uint8_t[]> tmp(new uint8_t[page.size]);
-        std::memcpy(tmp.get(), page.value.get(), page.size);
-        raw_writable.insert(std::make_pair(upper, std::move(tmp)));
-      }
+    /**
+     * Write out the data selected by read_writable.
+     */
+    void write_out();
 
-      return raw_writable.at(upper).get() + lower;
-    }
+    /**
+     * Execute atomic read-modify-write operation for integer value.
+     * The operation is executed by master of the page, thread is interrupted until master replies
+     * if this node isn't master, and the same call after that returns the result.
+     * @param dst Target address.
+     * @param type Kind of operation.
+     * @param operand Operand of operation, the size is same as target value.
+     * @param compare Value to compare for AT_CMPXCHG, empty for other operation.
+     * @return Value before the operation.
+     */
+    std::string atomic(vaddr_t dst, AtomicType type, const std::string& operand,
+                       const std::string& compare);
 
     /**
-     * Write out the data selected by get_raw_writable.
+     * Release result of atomic operation after output of the instruction is written.
+     * Until this, atomic returns the same result to the instruction executed again by interrupt.
      */
-    void write_out();
+    void finish_atomic();
+
+    /**
+     * Require pages that will be used soon by one command without waiting.
+     * Pages this node has latest value or requiring yet are skipped.
+     * @param addrs Upper addresses of pages.
+     */
+    void prefetch(const std::vector<vaddr_t>& addrs);
+
+    /**
+     * Give master flag of pages used by a thread to another node with warp command.
+     * Pages in addrs are given always, and pages in translation cache are given within the warp
+     * budget of the space. Pages this node isn't master or kept by master key are skipped.
+     * Value is omitted for pre-copied pages if the destination has acknowledged latest copy.
+     * @param addrs Addresses of pages the thread needs to resume.
+     * @param dst_nid Node-id to give master flag.
+     * @param precopied Pages sent by copy_bundle to the destination.
+     * @return Parameters of give for each page, to pass to recv_bundle in destination node.
+     */
+    picojson::array give_bundle(const std::vector<vaddr_t>& addrs, const nid_t& dst_nid,
+                                const std::set<vaddr_t>& precopied);
+
+    /**
+     * Give master flag of all pages this node is master of in the space with warp command.
+     * Used when all threads in this node warp together, so that the process moves at once
+     * instead of being required page by page. Pages kept by master key are skipped.
+     * @param dst_nid Node-id to give master flag.
+     * @param precopied Pages sent by copy_bundle to the destination.
+     * @return Parameters of give for each page, to pass to recv_bundle in destination node.
+     */
+    picojson::array give_space(const nid_t& dst_nid, const std::set<vaddr_t>& precopied);
+
+    /**
+     * Send copy of pages used by a thread to warp destination before stopping the thread.
+     * Pages are selected same as give_bundle, and the destination is added to copy nodes of them,
+     * so that pages changed after this call are sent by copy command as other copy nodes.
+     * @param addrs Addresses of pages the thread needs to resume.
+     * @param dst_nid Warp destination node-id.
+     * @param sent Pages sent by previous calls, pages sent by this call are added.
+     * @param dirty Set to bytes of pages not sent yet or changed but not acknowledged.
+     * @return Parameters of copy for each page, to pass to recv_bundle in destination node.
+     */
+    picojson::array copy_bundle(const std::vector<vaddr_t>& addrs, const nid_t& dst_nid,
+                                std::set<vaddr_t>& sent, uint64_t& dirty);
+
+    /**
+     * Estimate pages given with warp of a thread, selected same as give_bundle.
+     * @param addrs Addresses of pages the thread needs to resume.
+     * @param pages Set to count of pages.
+     * @param bytes Set to bytes of pages.
+     */
+    void estimate_warp(const std::vector<vaddr_t>& addrs, uint64_t& pages, uint64_t& bytes);
 
     /**
      */
     void write_copy(vaddr_t dst, vaddr_t src, uint64_t size) {
-      Page& src_page = get_page(get_upper_addr(src), true);
+      Page& src_page = get_page(get_upper_addr(src), true, get_lower_addr(src), size);
       Page& dst_page = get_page(get_upper_addr(dst), false);
 
       switch (dst_page.type) {
         case PT_MASTER: {
           assert(dst_page.size >= get_lower_addr(dst) + size);
-          std::memmove(dst_page.value.get() + get_lower_addr(dst),
-                       src_page.value.get() + get_lower_addr(src), size);
+          dst_page.value.store(get_lower_addr(dst),
+                               src_page.value.get_readonly() + get_lower_addr(src), size);
+          vmemory.update_master(space, dst_page, get_upper_addr(dst), get_lower_addr(dst),
+                                size);
         } break;
 
         case PT_COPY: {
-          assert(dst_page.hint.size() == 1);
-          dst_page.flg_update = false;
-          vmemory.send_command_update(*dst_page.hint.begin(), space, dst,
-                                      reinterpret_cast<const uint8_t*>(src_page.value.get() +
-                                                                       get_lower_addr(src)), size);
+          if (&src_page == &dst_page) {
+            // Master has source range too, send only the range.
+            vmemory.write_remote(space, dst_page, get_upper_addr(dst),
+                                 {RemoteOp::MOVE, get_lower_addr(dst), size, std::string(), 0,
+                                  get_lower_addr(src), 0, 0});
+          } else {
+            const char* data =
+                reinterpret_cast<const char*>(src_page.value.get_readonly() + get_lower_addr(src));
+            vmemory.write_remote(space, dst_page, get_upper_addr(dst),
+                                 {RemoteOp::STORE, get_lower_addr(dst), size,
+                                  std::string(data, size), 0, 0, 0, 0});
+          }
         } break;
 
         default: {
@@ -445,14 +865,16 @@ class VMemory {
       switch (dst_page.type) {
         case PT_MASTER: {
           assert(dst_page.size >= get_lower_addr(dst) + size);
-          std::memmove(dst_page.value.get() + get_lower_addr(dst), src, size);
+          dst_page.value.store(get_lower_addr(dst), src, size);
+          vmemory.update_master(space, dst_page, get_upper_addr(dst), get_lower_addr(dst),
+                                size);
         } break;
 
         case PT_COPY: {
-          assert(dst_page.hint.size() == 1);
-          dst_page.flg_update = false;
-          vmemory.send_command_update(*dst_page.hint.begin(), space, dst,
-                                      reinterpret_cast<const uint8_t*>(src), size);
+          vmemory.write_remote(space, dst_page, get_upper_addr(dst),
+                               {RemoteOp::STORE, get_lower_addr(dst), size,
+                                std::string(reinterpret_cast<const char*>(src), size),
+                                0, 0, 0, 0});
         } break;
 
         default: {
@@ -462,11 +884,25 @@ class VMemory {
       }
     }
 
-    void print_dump();
-
    private:
-    /** Map of upper address and copy of raw writable area.  */
-    std::map<vaddr_t, std::unique_ptr<uint8_t[]>> raw_writable;
+    /** Area selected by read_writable. */
+    struct WritableArea {
+      /** Duplicated value for copy page, empty for master page written in place. */
+      PageBuffer copy;
+      /** Begin of dirty range in the page. */
+      uint64_t begin;
+      /** End of dirty range in the page. */
+      uint64_t end;
+    };
+
+    /** Map of upper address and raw writable area. */
+    std::map<vaddr_t, WritableArea> raw_writable;
+    /** Serial number of atomic operation waiting for reply, 0 if there is no operation. */
+    uint64_t atomic_waiting;
+
+    std::vector<vaddr_t> get_working_set(const std::vector<vaddr_t>& addrs);
+    void give_page(vaddr_t addr, Page& page, const nid_t& dst_nid,
+                   const std::set<vaddr_t>& precopied, picojson::array& bundle);
 
     /** Block copy operator. */
     Accessor& operator=(const Accessor&);
@@ -504,9 +940,134 @@ class VMemory {
    */
   void set_loading(const std::string& name, bool flg);
 
+  /**
+   * Switch prefetch for pages pointed by arrived page.
+   * @param name Space name.
+   * @param flg True if enable prefetch.
+   */
+  void set_prefetch(const std::string& name, bool flg);
+
+  /**
+   * Change limit of bytes of copy pages in a memory space.
+   * @param name Space name.
+   * @param budget Limit of bytes.
+   */
+  void set_copy_budget(const std::string& name, uint64_t budget);
+
+  /**
+   * Change limit of bytes of recently accessed pages given with warp of a thread.
+   * @param name Space name.
+   * @param budget Limit of bytes.
+   */
+  void set_warp_budget(const std::string& name, uint64_t budget);
+
+  /**
+   * Receive pages given by Accessor::give_bundle or copied by Accessor::copy_bundle in another
+   * node.
+   * @param name Space name.
+   * @param src_nid Node-id sent pages.
+   * @param bundle Parameters of give or copy for each page.
+   * @param tid Thread-id copies are sent for by pre-copy, not used for give.
+   */
+  void recv_bundle(const std::string& name, const nid_t& src_nid, const picojson::array& bundle,
+                   vtid_t tid = 0);
+
+  /**
+   * Release pages received by pre-copy of threads, when warp of them arrives.
+   * Pages given with warp are released already, others left are not given and can be evicted.
+   * @param name Space name.
+   * @param src_nid Node-id sent pre-copy.
+   * @param tids Thread-ids warped.
+   */
+  void release_precopied(const std::string& name, const nid_t& src_nid,
+                         const std::set<vtid_t>& tids);
+
+  /**
+   * Remove pages not given to a node now from a bundle kept to resend.
+   * Pages given back to this node or moved to another node since are removed, so that resent
+   * bundle doesn't make two masters of them.
+   * @param name Space name.
+   * @param dst_nid Node-id the bundle was given to.
+   * @param bundle Parameters of give made by Accessor::give_bundle or Accessor::give_space.
+   */
+  void filter_given(const std::string& name, const nid_t& dst_nid, picojson::array& bundle);
+
+  /**
+   * Resend atomic and update commands not replied within MEMORY_REQUIRE_INTERVAL in all spaces.
+   * Prefetch not replied within the interval and pre-copy not given in PRECOPY_TIMEOUT are
+   * dropped.
+   * @param now Current time (msec).
+   */
+  void resend_commands(uint64_t now);
+
+  /**
+   * Replace policy to move master flag and copy of pages.
+   * @param policy New policy.
+   */
+  void set_migration_policy(std::unique_ptr<MigrationPolicy> policy);
+
+  /**
+   * Get statistics of a memory space.
+   * Count and bytes of pages are counted by scanning the space at this time.
+   * @param name Space name.
+   * @return Statistics.
+   */
+  picojson::object get_stats(const std::string& name);
+
+  /**
+   * Take snapshot of master and program pages in a memory space.
+   * Values are not copied, storage is shared with the pages until one of them is written.
+   * @param name Space name.
+   * @param with_copies True if readable copy pages are taken too, as master pages.
+   * @return Map of upper address and value of page.
+   */
+  std::map<vaddr_t, PageImage> snapshot(const std::string& name, bool with_copies = false);
+
+  /**
+   * Check snapshot of a memory space contains all pages of it.
+   * Pages mastered by other nodes and not taken as copies are missing from snapshot.
+   * @param name Space name.
+   * @param with_copies Same flag as snapshot.
+   * @return True if no page is missing.
+   */
+  bool is_snapshot_complete(const std::string& name, bool with_copies = false);
+
+  /**
+   * Write pages taken by snapshot to a stream as binary image.
+   * Values are written by blocks, blocks filled by zero are not written.
+   * @param images Pages taken by snapshot.
+   * @param os Stream to write.
+   */
+  static void write_image(std::map<vaddr_t, PageImage>& images, std::ostream& os);
+
+  /**
+   * Read pages written by write_image into a memory space, this node becomes master of them.
+   * Whole of image is read before changing the space, so the space isn't changed by error.
+   * @param name Space name.
+   * @param is Stream to read.
+   * @param overwrite True if pages this node has at the same address are replaced.
+   * @return False if the image is not read because it collides with pages this node has.
+   */
+  bool read_image(const std::string& name, std::istream& is, bool overwrite = true);
+
+  /**
+   * Print statistics and summary of pages in a memory space.
+   * This method is usable when compiled by debug mode, otherwise, this method do nothing.
+   * @param name Space name.
+   */
+  void print_dump(const std::string& name);
+
  private:
   /** Delegate for controller. */
   VMemoryDelegate& delegate;
+  /** Map of lease partition and node-id that assigns addresses from it. */
+  std::map<vaddr_t, nid_t> partition_nids;
+  /** Lease partitions shared by some nodes, master of addresses in them isn't known by hash. */
+  std::set<vaddr_t> shared_partitions;
+  /** True if another node has the same lease partition, addresses are reserved by command. */
+  bool is_lease_shared;
+  /** Policy to move master flag and copy of pages. */
+  std::unique_ptr<MigrationPolicy> policy;
 
   /** Block copy constructor. */
   VMemory(const VMemory&);
@@ -514,16 +1075,40 @@ class VMemory {
   /** Block copy operator. */
   VMemory& operator=(const VMemory&);
 
+  void recv_command_atomic(const CommandPacket& packet);
+  void recv_command_atomic_reply(const CommandPacket& packet);
+  static std::string apply_atomic(Page& page, uint64_t offset, AtomicType type,
+                                  const std::string& operand, const std::string& compare);
   void recv_command_copy(const CommandPacket& packet);
   void recv_command_copy_reply(const CommandPacket& packet);
   void recv_command_free(const CommandPacket& packet);
   void recv_command_give(const CommandPacket& packet);
+  void recv_give(const std::string& name, const nid_t& src_nid, const picojson::object& content);
+  void recv_precopy(Space& space, const nid_t& src_nid, vtid_t tid,
+                    const picojson::object& content);
   void recv_command_require(const CommandPacket& packet);
+  void recv_command_require_batch(const CommandPacket& packet);
   void recv_command_reserve(const CommandPacket& packet);
   void recv_command_stand(const CommandPacket& packet);
   void recv_command_unwant(const CommandPacket& packet);
   void recv_command_update(const CommandPacket& packet);
+  void recv_command_update_reply(const CommandPacket& packet);
+  static bool apply_op(Page& page, const RemoteOp& op);
+  static void count_message(std::map<std::string, MessageStats>& stats,
+                            const std::string& command, const picojson::object& content);
+  static const uint8_t* json2value(const picojson::object& content, std::string& buffer,
+                                   uint64_t& length);
   void send_memory_command(const std::string& name, const nid_t& dst_nid,
                            const std::string& command, picojson::object& param);
+  nid_t get_location(Space& space, vaddr_t addr);
+  void give_master(Space& space, Page& page, vaddr_t addr, const nid_t& dst_nid,
+                   picojson::array* bundle = nullptr, bool with_value = true);
+  void evict_copies(Space& space);
+  void learn_partition(const nid_t& nid);
+  void prefetch_pointers(Space& space, vaddr_t addr);
+  void reply_require(const std::string& name, const nid_t& src_nid,
+                     const std::vector<vaddr_t>& addrs, bool is_broadcast, unsigned int hop,
+                     uint64_t offset, uint64_t length, uint64_t version);
+  void set_location(Space& space, vaddr_t addr, const nid_t& nid);
 };
 }  // namespace processwarp
@@ -19,6 +19,7 @@
 #include "logger.hpp"
 #include "router.hpp"
 #include "server_connector.hpp"
+#include "trace.hpp"
 #include "util.hpp"
 #include "worker_connector.hpp"
 
@@ -218,13 +219,21 @@ int Daemon::main_loop() {
   }
   Logger::info(DaemonMid::L3009, run_mode_string.c_str());
 
+  // Write trace of warp if the directory is configured.
+  std::string trace_dir;
+  if (config.find("trace_dir") != config.end()) {
+    trace_dir = config.at("trace_dir").get<std::string>();
+    Trace::initialize(trace_dir, "daemon");
+  }
+
   server.initialize(loop, config.at("server").get<std::string>());
   router.initialize(loop, config);
   frontend.initialize(loop, config.at("frontend_pipe").get<std::string>());
   worker.initialize(loop,
                     config.at("worker_pipe").get<std::string>(),
                     config.at("libs").get<picojson::array>(),
-                    config.at("lib_filter").get<picojson::array>());
+                    config.at("lib_filter").get<picojson::array>(),
+                    trace_dir);
 
   server.send_connect_node(config.at("account").get<std::string>(),
                            config.at("password").get<std::string>());
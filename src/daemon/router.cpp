@@ -213,13 +213,14 @@ void Router::relay_command(const CommandPacket& packet, bool is_from_server) {
  * @param proc_addr Address of process information for new vm.
  * @param master_nid Node-id of master node for new vm.
  * @param name Process name for new vm.
+ * @param image Path of memory image to restore, or empty.
  */
 void Router::scheduler_create_vm(Scheduler& scheduler, const vpid_t& pid, vtid_t root_tid,
                                  vaddr_t proc_addr, const nid_t& master_nid,
-                                 const std::string& name) {
+                                 const std::string& name, const std::string& image) {
   WorkerConnector& worker = WorkerConnector::get_instance();
 
-  worker.create_vm(pid, root_tid, proc_addr, master_nid, name);
+  worker.create_vm(pid, root_tid, proc_addr, master_nid, name, image);
 }
 
 /**
@@ -1,6 +1,7 @@
 
 #include <dlfcn.h>
 
+#include <cstdio>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
@@ -9,6 +10,7 @@
 #include "constant.hpp"
 #include "daemon_mid.hpp"
 #include "logger.hpp"
+#include "trace.hpp"
 #include "worker.hpp"
 
 namespace processwarp {
@@ -382,11 +384,34 @@ void Worker::recv_connect_worker(const picojson::object& content) {
     initialize_lib_filter(content.at("lib_filter").get<picojson::array>());
   }
 
+  // Write trace of warp if the directory is given.
+  if (content.find("trace_dir") != content.end()) {
+    Trace::initialize(content.at("trace_dir").get<std::string>(),
+                      "worker-" + Convert::vpid2str(my_pid));
+  }
+
   // Create virtual machine.
   initialize_vm(Convert::json2vtid(content.at("root_tid")),
                 Convert::json2vaddr(content.at("proc_addr")),
                 Convert::json2nid(content.at("master_nid")),
                 content.at("name").get<std::string>());
+
+  // Restore process from checkpoint or image written by loader if it is given.
+  auto it_restore = content.find("restore");
+  if (it_restore != content.end()) {
+    const std::string& path = it_restore->second.get<std::string>();
+    bool is_restored = vm->restore(path);
+    // Image written by loader is used once.
+    auto it_remove = content.find("remove_image");
+    if (it_remove != content.end() && it_remove->second.get<bool>()) {
+      std::remove(path.c_str());
+    }
+    if (!is_restored) {
+      // Worker without pages would wait for them forever, exit to tell it to the daemon.
+      Logger::err(DaemonMid::L3010, path.c_str());
+      exit(EXIT_FAILURE);
+    }
+  }
   initialize_loop();
 }
 
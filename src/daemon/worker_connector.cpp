@@ -40,12 +40,15 @@ WorkerConnector::WorkerConnector() {
  * @param pipe_path_ Path of pipe that for connecting with worker.
  * @param libs Library pathes to send to worker process.
  * @param lib_filter Library filter to send to worker process.
+ * @param trace_dir Directory to write trace by worker process, or empty.
  */
 void WorkerConnector::initialize(uv_loop_t* loop, const std::string& pipe_path_,
-                                 const picojson::array& libs, const picojson::array& lib_filter) {
+                                 const picojson::array& libs, const picojson::array& lib_filter,
+                                 const std::string& trace_dir) {
   pipe_path     = pipe_path_;
   config_libs   = libs;
   config_lib_filter = lib_filter;
+  config_trace_dir  = trace_dir;
 
   Connector::initialize(loop, pipe_path);
 }
@@ -60,9 +63,11 @@ void WorkerConnector::initialize(uv_loop_t* loop, const std::string& pipe_path_,
  * @param proc_addr Address of process information for new vm.
  * @param master_nid Node-id of master node for new vm.
  * @param name Process name for new vm.
+ * @param image Path of memory image to restore, or empty.
  */
 void WorkerConnector::create_vm(const vpid_t& pid, vtid_t root_tid, vaddr_t proc_addr,
-                                const nid_t& master_nid, const std::string& name) {
+                                const nid_t& master_nid, const std::string& name,
+                                const std::string& image) {
   std::string worker_path = Util::file_dirname(Util::get_my_fullpath()) + "/worker";
   Router& router = Router::get_instance();
 
@@ -119,6 +124,14 @@ void WorkerConnector::create_vm(const vpid_t& pid, vtid_t root_tid, vaddr_t proc
   connect_data.insert(std::make_pair("name", picojson::value(std::string(name))));
   connect_data.insert(std::make_pair("libs", picojson::value(config_libs)));
   connect_data.insert(std::make_pair("lib_filter", picojson::value(config_lib_filter)));
+  if (!image.empty()) {
+    // Image is written by loader for this vm.
+    connect_data.insert(std::make_pair("restore", picojson::value(image)));
+    connect_data.insert(std::make_pair("remove_image", picojson::value(true)));
+  }
+  if (!config_trace_dir.empty()) {
+    connect_data.insert(std::make_pair("trace_dir", picojson::value(config_trace_dir)));
+  }
   send_data(pid, connect_data);
 }
 
@@ -18,9 +18,10 @@ class WorkerConnector : public Connector {
   static WorkerConnector& get_instance();
 
   void initialize(uv_loop_t* loop, const std::string& pipe_path_,
-                  const picojson::array& libs, const picojson::array& lib_filter);
+                  const picojson::array& libs, const picojson::array& lib_filter,
+                  const std::string& trace_dir);
   void create_vm(const vpid_t& pid, vtid_t root_tid, vaddr_t proc_addr,
-                 const nid_t& master_nid, const std::string& name);
+                 const nid_t& master_nid, const std::string& name, const std::string& image);
   void relay_command(const CommandPacket& packet);
 
  private:
@@ -41,6 +42,8 @@ class WorkerConnector : public Connector {
   picojson::array config_lib_filter;
   /** Path of pipe that for connecting with worker. */
   std::string pipe_path;
+  /** Directory to write trace, or empty if trace is disabled. */
+  std::string config_trace_dir;
 
   WorkerConnector();
   WorkerConnector(const WorkerConnector&);
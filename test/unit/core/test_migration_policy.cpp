@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "constant_vm.hpp"
+#include "migration_policy.hpp"
+
+namespace processwarp {
+class MigrationPolicyTest : public ::testing::Test {
+ public:
+  DefaultMigrationPolicy policy;
+  const nid_t nid1 = "0000000000000001";
+  const nid_t nid2 = "0000000000000002";
+
+  /**
+   * Move the window of statistics back as if windows have elapsed.
+   * @param stats Target statistics.
+   * @param windows Count of windows elapsed.
+   */
+  static void elapse(PageStats& stats, int windows) {
+    stats.window_begin -= windows * VMemoryMigration::WINDOW;
+  }
+};
+
+TEST_F(MigrationPolicyTest, give_on_write_streak) {
+  PageStats stats;
+  for (unsigned int i = 1; i < VMemoryMigration::WRITE_STREAK; i++) {
+    stats.record_remote_write(nid1);
+    EXPECT_FALSE(policy.should_give_on_write(stats, nid1));
+  }
+  stats.record_remote_write(nid1);
+  EXPECT_TRUE(policy.should_give_on_write(stats, nid1));
+  EXPECT_FALSE(policy.should_give_on_write(stats, nid2));
+
+  // Write by another node breaks the streak.
+  stats.record_remote_write(nid2);
+  EXPECT_FALSE(policy.should_give_on_write(stats, nid1));
+  EXPECT_FALSE(policy.should_give_on_write(stats, nid2));
+
+  // Read by another node and access in this node break the streak too.
+  for (unsigned int i = 0; i < VMemoryMigration::WRITE_STREAK; i++) {
+    stats.record_remote_write(nid1);
+  }
+  stats.record_remote_read(nid2);
+  EXPECT_FALSE(policy.should_give_on_write(stats, nid1));
+  for (unsigned int i = 0; i < VMemoryMigration::WRITE_STREAK; i++) {
+    stats.record_remote_write(nid1);
+  }
+  stats.record_local();
+  EXPECT_FALSE(policy.should_give_on_write(stats, nid1));
+}
+
+TEST_F(MigrationPolicyTest, give_on_write_pinned) {
+  PageStats stats;
+  for (unsigned int i = 1; i < VMemoryMigration::PIN_GIVES; i++) {
+    stats.record_give();
+  }
+  for (unsigned int i = 0; i < VMemoryMigration::WRITE_STREAK; i++) {
+    stats.record_remote_write(nid1);
+  }
+  EXPECT_TRUE(policy.should_give_on_write(stats, nid1));
+
+  // Page gave master flag frequently is pinned.
+  stats.record_give();
+  for (unsigned int i = 0; i < VMemoryMigration::WRITE_STREAK; i++) {
+    stats.record_remote_write(nid1);
+  }
+  EXPECT_FALSE(policy.should_give_on_write(stats, nid1));
+}
+
+TEST_F(MigrationPolicyTest, give_on_read) {
+  PageStats stats;
+  for (unsigned int i = 1; i < VMemoryMigration::READ_LIMIT; i++) {
+    stats.record_remote_read(nid1);
+    EXPECT_FALSE(policy.should_give_on_read(stats, nid1));
+  }
+  stats.record_remote_read(nid1);
+  EXPECT_TRUE(policy.should_give_on_read(stats, nid1));
+  EXPECT_FALSE(policy.should_give_on_read(stats, nid2));
+
+  // Reader isn't the heaviest if other nodes read the page as many times.
+  PageStats shared;
+  for (unsigned int i = 0; i < VMemoryMigration::READ_LIMIT; i++) {
+    shared.record_remote_read(nid1);
+    shared.record_remote_read(nid2);
+  }
+  EXPECT_FALSE(policy.should_give_on_read(shared, nid1));
+  shared.record_remote_read(nid1);
+  EXPECT_TRUE(policy.should_give_on_read(shared, nid1));
+
+  // Page used in this node or written by another node is kept.
+  PageStats used = stats;
+  used.record_local();
+  EXPECT_FALSE(policy.should_give_on_read(used, nid1));
+  PageStats written = stats;
+  written.record_remote_write(nid2);
+  EXPECT_FALSE(policy.should_give_on_read(written, nid1));
+}
+
+TEST_F(MigrationPolicyTest, give_on_read_pinned) {
+  PageStats stats;
+  for (unsigned int i = 0; i < VMemoryMigration::PIN_GIVES; i++) {
+    stats.record_give();
+  }
+  for (unsigned int i = 0; i < VMemoryMigration::READ_LIMIT; i++) {
+    stats.record_remote_read(nid1);
+  }
+  EXPECT_FALSE(policy.should_give_on_read(stats, nid1));
+}
+
+TEST_F(MigrationPolicyTest, keep_copy) {
+  PageStats stats;
+  for (unsigned int i = 1; i < VMemoryMigration::COPY_LIMIT; i++) {
+    stats.record_copy();
+    EXPECT_TRUE(policy.should_keep_copy(stats));
+  }
+  stats.record_copy();
+  EXPECT_FALSE(policy.should_keep_copy(stats));
+
+  // Copy read in this node is kept however many times it is updated.
+  stats.record_local();
+  for (unsigned int i = 0; i < VMemoryMigration::COPY_LIMIT; i++) {
+    stats.record_copy();
+  }
+  EXPECT_TRUE(policy.should_keep_copy(stats));
+
+  // Access counter is halved to zero after the window.
+  elapse(stats, 1);
+  stats.record_copy();
+  EXPECT_FALSE(policy.should_keep_copy(stats));
+}
+
+TEST_F(MigrationPolicyTest, window) {
+  PageStats stats;
+  for (unsigned int i = 0; i < VMemoryMigration::PIN_GIVES; i++) {
+    stats.record_give();
+  }
+  for (unsigned int i = 0; i < VMemoryMigration::READ_LIMIT; i++) {
+    stats.record_remote_read(nid1);
+  }
+  stats.record_local();
+  stats.record_remote_write(nid2);
+  EXPECT_FALSE(policy.should_give_on_write(stats, nid2));
+
+  // Counters are halved after a window, counter becoming zero is removed.
+  elapse(stats, 1);
+  stats.record_copy();
+  EXPECT_EQ(0U, stats.local_access);
+  EXPECT_EQ(VMemoryMigration::PIN_GIVES / 2, stats.gives);
+  EXPECT_TRUE(stats.remote_writes.empty());
+  EXPECT_EQ(VMemoryMigration::READ_LIMIT / 2, stats.remote_reads.at(nid1));
+
+  // Pinned page is released after windows.
+  for (unsigned int i = 0; i < VMemoryMigration::WRITE_STREAK; i++) {
+    stats.record_remote_write(nid1);
+  }
+  EXPECT_TRUE(policy.should_give_on_write(stats, nid1));
+
+  // Window begins at the boundary of elapsed windows.
+  std::time_t window_begin = stats.window_begin;
+  elapse(stats, 3);
+  stats.record_remote_write(nid1);
+  EXPECT_EQ(window_begin, stats.window_begin);
+  EXPECT_EQ(0U, stats.gives);
+  EXPECT_EQ(1U, stats.remote_writes.at(nid1));
+}
+}  // namespace processwarp
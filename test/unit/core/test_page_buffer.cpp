@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+
+#include "page_buffer.hpp"
+
+namespace processwarp {
+class PageBufferTest : public ::testing::Test {
+ public:
+};
+
+TEST_F(PageBufferTest, zero_without_storage) {
+  PageBuffer buffer;
+  buffer.allocate(1024);
+
+  EXPECT_TRUE(buffer.is_zero(0, 1024));
+  EXPECT_EQ(0, buffer.get_readonly()[512]);
+
+  uint8_t zero[16] = {0};
+  buffer.store(100, zero, sizeof(zero));
+  EXPECT_TRUE(buffer.is_zero(0, 1024));
+
+  uint8_t data[4] = {1, 2, 3, 4};
+  buffer.store(100, data, sizeof(data));
+  EXPECT_FALSE(buffer.is_zero(0, 1024));
+  EXPECT_TRUE(buffer.is_zero(0, 100));
+  EXPECT_EQ(0, std::memcmp(buffer.get_readonly() + 100, data, sizeof(data)));
+
+  buffer.fill_zero(0, 1024);
+  EXPECT_TRUE(buffer.is_zero(0, 1024));
+}
+
+TEST_F(PageBufferTest, copy_on_write) {
+  PageBuffer buffer;
+  buffer.allocate(256);
+  uint8_t data[4] = {1, 2, 3, 4};
+  buffer.store(0, data, sizeof(data));
+
+  PageBuffer shared = buffer.share();
+  EXPECT_TRUE(buffer.is_shared());
+  EXPECT_TRUE(shared.is_shared());
+  EXPECT_EQ(buffer.get_readonly(), shared.get_readonly());
+
+  // Writing to one buffer doesn't change another.
+  uint8_t other[4] = {5, 6, 7, 8};
+  shared.store(0, other, sizeof(other));
+  EXPECT_FALSE(buffer.is_shared());
+  EXPECT_FALSE(shared.is_shared());
+  EXPECT_NE(buffer.get_readonly(), shared.get_readonly());
+  EXPECT_EQ(0, std::memcmp(buffer.get_readonly(), data, sizeof(data)));
+  EXPECT_EQ(0, std::memcmp(shared.get_readonly(), other, sizeof(other)));
+
+  // The last buffer takes over the storage without copying.
+  PageBuffer shared2 = buffer.share();
+  const uint8_t* ptr = buffer.get_readonly();
+  shared2.reset();
+  EXPECT_FALSE(buffer.is_shared());
+  EXPECT_EQ(ptr, buffer.get());
+}
+
+TEST_F(PageBufferTest, resize_shared) {
+  PageBuffer buffer;
+  buffer.allocate(128);
+  std::memset(buffer.get(), 0xAB, 128);
+
+  PageBuffer shared = buffer.share();
+  buffer.resize(256);
+  EXPECT_FALSE(shared.is_shared());
+  EXPECT_EQ(0xAB, buffer.get_readonly()[127]);
+  EXPECT_EQ(0, buffer.get_readonly()[128]);
+  EXPECT_EQ(0xAB, shared.get_readonly()[127]);
+
+  shared.fill_zero(0, 64);
+  EXPECT_EQ(0xAB, buffer.get_readonly()[0]);
+  EXPECT_EQ(0, shared.get_readonly()[0]);
+}
+
+TEST_F(PageBufferTest, resize_after_share_released) {
+  PageBuffer buffer;
+  buffer.allocate(512 * 1024);
+  buffer.get()[1000] = 0xCD;
+
+  PageBuffer shared = buffer.share();
+  shared.reset();
+  buffer.resize(1024 * 1024);
+  EXPECT_FALSE(buffer.is_shared());
+  EXPECT_EQ(0xCD, buffer.get_readonly()[1000]);
+  EXPECT_EQ(0, buffer.get_readonly()[600 * 1024]);
+
+  buffer.resize(256 * 1024);
+  EXPECT_EQ(0xCD, buffer.get_readonly()[1000]);
+}
+}  // namespace processwarp
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+
+#include "page_table.hpp"
+
+namespace processwarp {
+class PageTableTest : public ::testing::Test {
+ public:
+};
+
+TEST_F(PageTableTest, insert_find_erase) {
+  PageTable<std::string> table;
+
+  EXPECT_TRUE(table.empty());
+  EXPECT_TRUE(table.insert(std::make_pair(0x1000000000000100, std::string("a"))).second);
+  EXPECT_TRUE(table.insert(std::make_pair(0x2000000000010000, std::string("b"))).second);
+  EXPECT_FALSE(table.insert(std::make_pair(0x1000000000000100, std::string("c"))).second);
+  EXPECT_EQ(static_cast<size_t>(2), table.size());
+
+  EXPECT_EQ(std::string("a"), table.find(0x1000000000000100)->second);
+  EXPECT_EQ(std::string("b"), table.find(0x2000000000010000)->second);
+  EXPECT_TRUE(table.find(0x3000000001000000) == table.end());
+
+  uint64_t generation = table.get_generation();
+  EXPECT_EQ(static_cast<size_t>(1), table.erase(0x1000000000000100));
+  EXPECT_EQ(static_cast<size_t>(0), table.erase(0x1000000000000100));
+  EXPECT_NE(generation, table.get_generation());
+  EXPECT_TRUE(table.find(0x1000000000000100) == table.end());
+  EXPECT_EQ(std::string("b"), table.find(0x2000000000010000)->second);
+}
+
+TEST_F(PageTableTest, compare_with_map) {
+  PageTable<uint64_t> table;
+  std::map<vaddr_t, uint64_t> expect;
+  std::mt19937_64 rnd(0);
+
+  for (int i = 0; i < 20000; i++) {
+    vaddr_t addr = 0x1000000000000000 | ((rnd() % 4096) << 8);
+    if (rnd() % 3 == 0) {
+      EXPECT_EQ(expect.erase(addr), table.erase(addr));
+    } else {
+      EXPECT_EQ(expect.insert(std::make_pair(addr, i)).second,
+                table.insert(std::make_pair(addr, static_cast<uint64_t>(i))).second);
+    }
+  }
+
+  EXPECT_EQ(expect.size(), table.size());
+  size_t count = 0;
+  for (auto& it : table) {
+    ASSERT_TRUE(expect.find(it.first) != expect.end());
+    EXPECT_EQ(expect.at(it.first), it.second);
+    count++;
+  }
+  EXPECT_EQ(expect.size(), count);
+}
+
+TEST_F(PageTableTest, stable_pointer) {
+  PageTable<int> table;
+  int* first = &table.insert(std::make_pair(0x1000000000000100, 1)).first->second;
+
+  for (vaddr_t i = 1; i < 1000; i++) {
+    table.insert(std::make_pair(0x1000000000000100 + (i << 8), static_cast<int>(i)));
+  }
+  EXPECT_EQ(first, &table.find(0x1000000000000100)->second);
+}
+
+TEST_F(PageTableTest, erase_while_iterating) {
+  PageTable<int> table;
+  for (vaddr_t i = 0; i < 100; i++) {
+    table.insert(std::make_pair(0x1000000000000100 + (i << 8), static_cast<int>(i)));
+  }
+
+  auto it = table.begin();
+  while (it != table.end()) {
+    if (it->second % 2 == 0) {
+      it = table.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  EXPECT_EQ(static_cast<size_t>(50), table.size());
+  for (auto& it_page : table) {
+    EXPECT_EQ(1, it_page.second % 2);
+  }
+}
+
+TEST_F(PageTableTest, resume_from_position) {
+  PageTable<int> table;
+  for (vaddr_t i = 0; i < 10; i++) {
+    table.insert(std::make_pair(0x1000000000000100 + (i << 8), static_cast<int>(i)));
+  }
+
+  auto it = table.begin();
+  ++it;
+  ++it;
+  vaddr_t third = it->first;
+  EXPECT_EQ(third, table.find_from(it.get_position())->first);
+
+  std::set<vaddr_t> rest;
+  for (auto it_rest = table.find_from(it.get_position()); it_rest != table.end(); ++it_rest) {
+    rest.insert(it_rest->first);
+  }
+  EXPECT_EQ(static_cast<size_t>(8), rest.size());
+  EXPECT_TRUE(table.find_from(table.end().get_position()) == table.end());
+}
+}  // namespace processwarp
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "error.hpp"
+#include "record.hpp"
+#include "stackinfo.hpp"
+#include "vmemory.hpp"
+
+namespace processwarp {
+class RecordTest : public ::testing::Test, public VMemoryDelegate {
+ public:
+  void vmemory_send_command(VMemory& memory, const nid_t& dst_nid, Module::Type module,
+                            const std::string& command, picojson::object& param) override {
+  }
+
+  void vmemory_recv_update(VMemory& memory, vaddr_t addr) override {
+  }
+
+  /**
+   * Read a record and get the reason of error.
+   * @param data Record.
+   * @return Reason of error thrown by reading the record.
+   */
+  static Error::Reason read_broken(const std::string& data) {
+    RecordReader reader(data);
+    try {
+      reader.get<uint8_t>();
+      reader.get<vaddr_t>();
+      reader.get_vector();
+      reader.get<uint32_t>();
+    } catch (const Error& e) {
+      return e.reason;
+    }
+    ADD_FAILURE() << "record is read without error";
+    return Error::PARSE;
+  }
+};
+
+TEST_F(RecordTest, round_trip) {
+  RecordWriter writer;
+  std::vector<vaddr_t> addrs = {0x1000000000000100, 0x2000000000010000};
+  writer.put<uint8_t>(3).put<vaddr_t>(0x3000000001000000);
+  writer.put_vector(addrs).put_vector(std::vector<vaddr_t>());
+  writer.put<uint32_t>(0xCAFEBABE).put<vm_int_t>(-1);
+  std::string data = writer.get();
+
+  RecordReader reader(data);
+  EXPECT_EQ(3, reader.get<uint8_t>());
+  EXPECT_EQ(0x3000000001000000U, reader.get<vaddr_t>());
+  EXPECT_EQ(addrs, reader.get_vector());
+  EXPECT_TRUE(reader.get_vector().empty());
+  reader.skip(sizeof(uint32_t));
+  EXPECT_EQ(-1, reader.get<vm_int_t>());
+  EXPECT_THROW(reader.get<uint8_t>(), Error);
+}
+
+TEST_F(RecordTest, truncated) {
+  RecordWriter writer;
+  std::vector<vaddr_t> addrs = {0x1000000000000100, 0x2000000000010000};
+  writer.put<uint8_t>(1).put<vaddr_t>(VADDR_NULL).put_vector(addrs).put<uint32_t>(0);
+  const std::string data = writer.get();
+
+  for (size_t length = 0; length < data.size(); length++) {
+    EXPECT_EQ(Error::PARSE, read_broken(data.substr(0, length)));
+  }
+
+  // Count of vector larger than the record.
+  RecordWriter broken;
+  broken.put<uint8_t>(1).put<vaddr_t>(VADDR_NULL).put<uint32_t>(0xFFFFFFFF);
+  EXPECT_EQ(Error::PARSE, read_broken(broken.get()));
+}
+
+TEST_F(RecordTest, stackinfo_write_changed_range) {
+  VMemory vmemory(*this, "0000000000000001");
+  std::unique_ptr<VMemory::Accessor> memory = vmemory.get_accessor("1");
+  vaddr_t stack = memory->alloc(16);
+  vaddr_t addr = StackInfo::alloc(*memory, 0x1000000000000100, VADDR_NULL, 1, 2, stack);
+  std::unique_ptr<StackInfo> stackinfo = StackInfo::read(*memory, addr);
+
+  // Nothing is written if no register is changed.
+  uint64_t version = memory->get_meta_version(addr);
+  stackinfo->write(*memory);
+  EXPECT_EQ(version, memory->get_meta_version(addr));
+
+  // Change var_arg from another place, it is before pc in the record.
+  const size_t var_arg_offset = sizeof(vaddr_t) * 3 + sizeof(uint32_t) * 2;
+  vaddr_t var_arg = 0x2000000000010000;
+  memory->update_meta_area(addr, var_arg_offset, reinterpret_cast<const uint8_t*>(&var_arg),
+                           sizeof(var_arg));
+
+  // Only pc is written back, var_arg changed from another place is kept.
+  stackinfo->pc = 10;
+  stackinfo->write(*memory);
+  std::unique_ptr<StackInfo> written = StackInfo::read(*memory, addr);
+  EXPECT_EQ(10U, written->pc);
+  EXPECT_EQ(var_arg, written->var_arg);
+  EXPECT_EQ(stack, written->stack);
+
+  // Size of record is changed by alloca, whole of the record is written.
+  stackinfo->alloca_addrs.push_back(0x1000000000000200);
+  stackinfo->write(*memory);
+  written = StackInfo::read(*memory, addr);
+  EXPECT_EQ(stackinfo->alloca_addrs, written->alloca_addrs);
+  EXPECT_EQ(static_cast<vaddr_t>(VADDR_NULL), written->var_arg);
+  EXPECT_EQ(10U, written->pc);
+}
+}  // namespace processwarp
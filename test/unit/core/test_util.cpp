@@ -14,6 +14,12 @@ TEST_F(UtilTest, calc_sha256) {
             Util::calc_sha256("test"));
 }
 
+TEST_F(UtilTest, calc_fnv1a) {
+  EXPECT_EQ(0xCBF29CE484222325, Util::calc_fnv1a(""));
+  EXPECT_EQ(0xAF63DC4C8601EC8C, Util::calc_fnv1a("a"));
+  EXPECT_EQ(0x85944171F73967E8, Util::calc_fnv1a("foobar"));
+}
+
 TEST_F(UtilTest, file_basename) {
   EXPECT_EQ(std::string("ef"), Util::file_basename("/ab/cd/ef"));
   EXPECT_EQ(std::string("ef"), Util::file_basename("ab/cd/ef"));
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "error.hpp"
+#include "vmemory.hpp"
+
+namespace processwarp {
+class VMemoryImageTest : public ::testing::Test, public VMemoryDelegate {
+ public:
+  void vmemory_send_command(VMemory& memory, const nid_t& dst_nid, Module::Type module,
+                            const std::string& command, picojson::object& param) override {
+  }
+
+  void vmemory_recv_update(VMemory& memory, vaddr_t addr) override {
+  }
+};
+
+TEST_F(VMemoryImageTest, round_trip) {
+  VMemory src(*this, "0000000000000001");
+  std::unique_ptr<VMemory::Accessor> src_memory = src.get_accessor("1");
+  vaddr_t small = src_memory->alloc(16);
+  vaddr_t large = src_memory->alloc(64 * 1024);
+  src_memory->write<uint64_t>(small, 0x0123456789ABCDEFULL);
+  src_memory->write<uint32_t>(large + 40000, 0xCAFEBABE);
+  src_memory->write_out();
+
+  std::map<vaddr_t, VMemory::PageImage> images = src.snapshot("1");
+  std::stringstream image;
+  VMemory::write_image(images, image);
+  // Zero blocks of the large page are not written.
+  EXPECT_LT(image.str().size(), static_cast<size_t>(16 * 1024));
+
+  VMemory dst(*this, "0000000000000002");
+  std::unique_ptr<VMemory::Accessor> dst_memory = dst.get_accessor("1");
+  dst.read_image("1", image);
+  EXPECT_EQ(0x0123456789ABCDEFULL, dst_memory->read<uint64_t>(small));
+  EXPECT_EQ(0xCAFEBABE, dst_memory->read<uint32_t>(large + 40000));
+  EXPECT_EQ(0U, dst_memory->read<uint32_t>(large + 1024));
+}
+
+TEST_F(VMemoryImageTest, collision) {
+  VMemory src(*this, "0000000000000001");
+  std::unique_ptr<VMemory::Accessor> src_memory = src.get_accessor("1");
+  vaddr_t addr = src_memory->alloc(16);
+  src_memory->write<uint32_t>(addr, 1);
+  std::map<vaddr_t, VMemory::PageImage> images = src.snapshot("1");
+  std::stringstream image;
+  VMemory::write_image(images, image);
+
+  // Page existing at the same address is kept unless overwrite.
+  src_memory->write<uint32_t>(addr, 2);
+  EXPECT_FALSE(src.read_image("1", image, false));
+  EXPECT_EQ(2U, src_memory->read<uint32_t>(addr));
+
+  image.clear();
+  image.seekg(0);
+  EXPECT_TRUE(src.read_image("1", image));
+  EXPECT_EQ(1U, src_memory->read<uint32_t>(addr));
+}
+
+TEST_F(VMemoryImageTest, broken_image) {
+  VMemory dst(*this, "0000000000000002");
+  std::unique_ptr<VMemory::Accessor> dst_memory = dst.get_accessor("1");
+  std::stringstream image("not an image");
+  EXPECT_THROW(dst.read_image("1", image), Error);
+}
+}  // namespace processwarp